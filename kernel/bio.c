@@ -1,17 +1,22 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
-// cached copies of disk block contents.  Caching disk blocks
-// in memory reduces the number of disk reads and also provides
+// The buffer cache is a hash table of buf structures holding
+// cached copies of disk block contents, indexed by (dev, sectorno).
+// Caching disk blocks in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
-// * After changing buffer data, call bwrite to write it to disk.
+// * After changing buffer data, call bwrite to mark it dirty;
+//     the flusher (bflushd) writes it to disk later, bsync forces it.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * breadn/bgetn lock a run of adjacent sectors at once, so that
+//     the disk can move them in one request; release them with brelsen.
+//     Whoever holds more than one buffer locks them in ascending
+//     sector order.
 
 //Buffer Cache的具体实现。因为读写磁盘操作效率不高，
 //根据时间与空间局部性原理，这里将最近经常访问的磁盘块缓存在内存中。
@@ -25,83 +30,346 @@
 #include "../libs/sdcard.h"
 #include "../libs/printf.h"
 #include "../libs/disk.h"
+#include "../libs/iostat.h"
+#include "../libs/proc.h"
 
 //高速缓存块
-//通过链表将所有buffer进行链接
-//spinlock是互斥原语，保证原子操作
+//按(dev, sectorno)散列到NBUCKET个桶中，每个桶有自己的锁，
+//命中时只需要持有对应桶的锁，两个核的查找互不干扰。
+//淘汰时按lastuse选择最久未使用的空闲块，由bcache.lock串行化。
+#define NBUCKET 13
+#define BHASH(dev, sectorno) ((((dev) << 16) ^ (sectorno)) % NBUCKET)
+#define BDIRTY_HIGH (NBUF / 2)  // wake the flusher at this many dirty buffers
+// Callers holding a run of buffers at once (breadn, bgetn)
+// are limited to NBVEC, so they can't use the whole cache up
+// between them and wait for each other forever.
+#define NBVEC ((NBUF - NBUF / 4) / MAXBVEC)
+
+struct bucket {
+  struct spinlock lock;
+  struct buf *head;       // chain of buffers through hnext
+  uint64 hit;             // lookups served from this bucket
+};
+
 struct {
+  // Serializes eviction. A buffer only changes buckets
+  // while this lock is held, so a lookup that misses its
+  // bucket can re-check it under this lock before recycling.
   struct spinlock lock;
   struct buf buf[NBUF];
+  struct bucket bucket[NBUCKET];
+
+  uint64 clock;           // source of lastuse stamps
+  uint64 miss;
+  uint64 nread;
+  uint64 nwrite;          // bwrite() calls
+  uint64 nwback;          // dirty buffers written to disk
+  uint64 ndread;          // disk read requests
+  uint64 ndwrite;         // disk write requests
+  int ndirty;
+  int nwait;              // bget() callers waiting for a free buffer
+
+  struct spinlock veclock;
+  int nvec;               // holders of buffer runs
+
+  // The flusher sleeps on kick until the timer or
+  // a pile-up of dirty buffers wakes it up.
+  struct spinlock flushlock;
+  int kick;
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  uint64 nra;             // sectors read ahead
+  uint64 rahit;           // read-ahead sectors later used by bread()
+  uint64 rawaste;         // read-ahead sectors recycled unused
 } bcache;
 
+// Read-ahead requests, served by the breadd kernel thread
+// so that the reader does not wait for them.
+#define RAQSIZE 8
+
+struct {
+  struct spinlock lock;
+  struct {
+    uint dev;
+    uint sectorno;
+    uint n;
+  } q[RAQSIZE];
+  uint head;              // next request to serve
+  uint tail;              // next free slot
+} raq;
+
 //cache的初始化
 void
 binit(void)
 {
   struct buf *b;
+  struct bucket *bk;
 
   initlock(&bcache.lock, "bcache");
+  initlock(&bcache.flushlock, "bflush");
+  initlock(&bcache.veclock, "bvec");
+  bcache.nvec = 0;
+  bcache.kick = 0;
+  initlock(&raq.lock, "raq");
+  raq.head = raq.tail = 0;
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    initlock(&bk->lock, "bcache.bucket");
+    bk->head = 0;
+    bk->hit = 0;
+  }
+  bcache.clock = 0;
+  bcache.miss = 0;
+  bcache.nread = 0;
+  bcache.nwrite = 0;
+  bcache.nwback = 0;
+  bcache.ndread = 0;
+  bcache.ndwrite = 0;
+  bcache.ndirty = 0;
+  bcache.nwait = 0;
+  bcache.nra = 0;
+  bcache.rahit = 0;
+  bcache.rawaste = 0;
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
+  // Hash every buffer under its (invalid) key.
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
     b->refcnt = 0;
+    b->dirty = 0;
+    b->ra = 0;
+    b->lastuse = 0;
     b->sectorno = ~0;
     b->dev = ~0;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    bk = &bcache.bucket[BHASH(b->dev, b->sectorno)];
+    b->hnext = bk->head;
+    bk->head = b;
   }
   #ifdef DEBUG
   printf("binit\n");
   #endif
 }
 
+// Find the buffer for the sector in bucket bk.
+// Caller must hold bk->lock.
+static struct buf*
+bfind(struct bucket *bk, uint dev, uint sectorno)
+{
+  struct buf *b;
+
+  for(b = bk->head; b != 0; b = b->hnext){
+    if(b->dev == dev && b->sectorno == sectorno)
+      return b;
+  }
+  return 0;
+}
+
+// Unlink b from the chain of bucket bk.
+// Caller must hold bk->lock.
+static void
+bunlink(struct bucket *bk, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &bk->head; *pp != 0; pp = &(*pp)->hnext){
+    if(*pp == b){
+      *pp = b->hnext;
+      b->hnext = 0;
+      return;
+    }
+  }
+  panic("bunlink");
+}
+
+// Start writing back the dirty buffers of adjacent sectors
+// run[0..n) with a single disk request.
+// Caller must hold their locks until bflushdone().
+static void
+bflushstart(struct buf **run, int n)
+{
+  disk_submit(run, n, 1);
+  __sync_fetch_and_add(&bcache.ndwrite, 1);
+}
+
+// Wait for the write-back bflushstart() started.
+static void
+bflushdone(struct buf **run, int n)
+{
+  disk_wait(run[0]);
+  for(int i = 0; i < n; i++){
+    run[i]->dirty = 0;
+    __sync_fetch_and_sub(&bcache.ndirty, 1);
+    __sync_fetch_and_add(&bcache.nwback, 1);
+  }
+}
+
+static void
+bflushrun(struct buf **run, int n)
+{
+  bflushstart(run, n);
+  bflushdone(run, n);
+}
+
+// Write b back if it is dirty. Caller must hold b->lock.
+static void
+bflushbuf(struct buf *b)
+{
+  if(b->dirty)
+    bflushrun(&b, 1);
+}
+
+// Drop a reference to b. The last one stamps it as the most
+// recently used buffer if asked to, and hands it to a bget()
+// waiting for a free buffer.
+static void
+bunref(struct buf *b, int stamp)
+{
+  struct bucket *bk;
+  int last;
+
+  // b cannot change buckets while we still hold a reference.
+  bk = &bcache.bucket[BHASH(b->dev, b->sectorno)];
+  acquire(&bk->lock);
+  b->refcnt--;
+  last = (b->refcnt == 0);
+  if (last && stamp) {
+    // no one is waiting for it.
+    b->lastuse = __sync_add_and_fetch(&bcache.clock, 1);
+  }
+  release(&bk->lock);
+
+  // pairs with the barrier in bget() after it bumps nwait.
+  __sync_synchronize();
+  if(last && bcache.nwait){
+    acquire(&bcache.lock);
+    wakeup(&bcache.nwait);
+    release(&bcache.lock);
+  }
+}
+
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
 // 给定dev号和扇区号
-// 遍历，如果扇区已分配则返回
-// 没分配就分配一个buffer并返回
+// 先只锁对应的桶查找，命中则返回
+// 没命中就在bcache.lock下回收最久未使用的干净buffer并返回，
+// 如果空闲的buffer全是脏的，先把最旧的一个写回再重试
+// 如果所有buffer都在使用中，睡眠等待brelse释放
 static struct buf*
 bget(uint dev, uint sectorno)
 {
-  struct buf *b;
-
-  acquire(&bcache.lock);
+  struct buf *b, *victim, *dvictim;
+  struct bucket *bk = &bcache.bucket[BHASH(dev, sectorno)];
+  struct bucket *vbk;
+  int waiting = 0;
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->sectorno == sectorno){
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, sectorno)) != 0){
+    b->refcnt++;
+    bk->hit++;
+    release(&bk->lock);
+    acquiresleep(&b->lock);
+    return b;
+  }
+  release(&bk->lock);
+
+  // Not cached.
+  acquire(&bcache.lock);
+  for(;;){
+    // Someone else may have recycled a buffer for this
+    // sector while we were not holding bcache.lock.
+    acquire(&bk->lock);
+    if((b = bfind(bk, dev, sectorno)) != 0){
       b->refcnt++;
+      bk->hit++;
+      release(&bk->lock);
+      if(waiting)
+        __sync_fetch_and_sub(&bcache.nwait, 1);
       release(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
     }
-  }
+    release(&bk->lock);
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->sectorno = sectorno;
-      b->valid = 0;
-      b->refcnt = 1;
+    // Recycle the least recently used (LRU) unused clean buffer.
+    // refcnt, dirty and lastuse are read without the bucket lock
+    // as a hint, then re-checked under the victim's bucket lock.
+    // An unused buffer's dirty flag can't change, since dirtying
+    // it takes a reference first.
+    victim = dvictim = 0;
+    for(b = bcache.buf; b < bcache.buf+NBUF; b++){
+      if(b->refcnt != 0)
+        continue;
+      if(b->dirty){
+        if(dvictim == 0 || b->lastuse < dvictim->lastuse)
+          dvictim = b;
+      } else if(victim == 0 || b->lastuse < victim->lastuse){
+        victim = b;
+      }
+    }
+    if(victim == 0 && dvictim == 0){
+      // Every buffer is in use, some callers hold whole runs.
+      // Announce ourselves and look once more before sleeping,
+      // so that a brelse() in between is sure to wake us up.
+      if(!waiting){
+        waiting = 1;
+        __sync_fetch_and_add(&bcache.nwait, 1);
+      } else {
+        sleep(&bcache.nwait, &bcache.lock);
+      }
+      continue;
+    }
+
+    if(victim == 0){
+      // Every unused buffer is dirty: write the oldest one back
+      // ourselves, and let the flusher catch up with the rest.
+      vbk = &bcache.bucket[BHASH(dvictim->dev, dvictim->sectorno)];
+      acquire(&vbk->lock);
+      if(dvictim->refcnt != 0 || !dvictim->dirty){
+        release(&vbk->lock);
+        continue;
+      }
+      dvictim->refcnt++;
+      release(&vbk->lock);
       release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+      bkick();
+      acquiresleep(&dvictim->lock);
+      bflushbuf(dvictim);
+      releasesleep(&dvictim->lock);
+      bunpin(dvictim);
+      acquire(&bcache.lock);
+      continue;
+    }
+
+    vbk = &bcache.bucket[BHASH(victim->dev, victim->sectorno)];
+    acquire(&vbk->lock);
+    if(victim->refcnt == 0 && !victim->dirty){
+      bunlink(vbk, victim);
+      release(&vbk->lock);
+      break;
     }
+    // lost a race with a lookup that hit the victim.
+    release(&vbk->lock);
   }
-  panic("bget: no buffers");
+
+  if(victim->ra){
+    bcache.rawaste++;
+    victim->ra = 0;
+  }
+  victim->dev = dev;
+  victim->sectorno = sectorno;
+  victim->valid = 0;
+  victim->refcnt = 1;
+  if(waiting)
+    __sync_fetch_and_sub(&bcache.nwait, 1);
+
+  acquire(&bk->lock);
+  victim->hnext = bk->head;
+  bk->head = victim;
+  release(&bk->lock);
+
+  bcache.miss++;
+  release(&bcache.lock);
+  acquiresleep(&victim->lock);
+  return victim;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -110,25 +378,143 @@ struct buf*
 bread(uint dev, uint sectorno) {
   struct buf *b;
 
+  __sync_fetch_and_add(&bcache.nread, 1);
   b = bget(dev, sectorno);
   if (!b->valid) {
     disk_read(b);
+    __sync_fetch_and_add(&bcache.ndread, 1);
     b->valid = 1;
+  } else if (b->ra) {
+    __sync_fetch_and_add(&bcache.rahit, 1);
+    b->ra = 0;
   }
 
   return b;
 }
 
-// Write b's contents to disk.  Must be locked.
+// Wait for a turn to hold a run of buffers.
+static void
+bvecbegin(void)
+{
+  acquire(&bcache.veclock);
+  while(bcache.nvec >= NBVEC)
+    sleep(&bcache.nvec, &bcache.veclock);
+  bcache.nvec++;
+  release(&bcache.veclock);
+}
+
+static void
+bvecend(void)
+{
+  acquire(&bcache.veclock);
+  bcache.nvec--;
+  wakeup(&bcache.nvec);
+  release(&bcache.veclock);
+}
+
+// Return a locked buf for one sector without reading it, for a
+// caller that overwrites all of it (e.g. the FAT2 copy of a FAT1
+// sector). A single buffer needs no bvecbegin().
+struct buf*
+bgetw(uint dev, uint sectorno)
+{
+  return bget(dev, sectorno);
+}
+
+// Return locked buffers for the n (<= MAXBVEC) sectors starting
+// at sectorno in bufs[], without reading them: the caller is going
+// to overwrite them (whatever is not valid).
+void
+bgetn(uint dev, uint sectorno, int n, struct buf **bufs)
+{
+  if(n < 1 || n > MAXBVEC)
+    panic("bgetn");
+  bvecbegin();
+  for(int i = 0; i < n; i++)
+    bufs[i] = bget(dev, sectorno + i);
+}
+
+// Start reading the buffers in bufs[0..n) that do not hold
+// valid data, one disk request per run of adjacent ones.
+static void
+bfillstart(struct buf **bufs, int n)
+{
+  int i, j;
+
+  for(i = 0; i < n; i = j){
+    j = i + 1;
+    if(bufs[i]->valid)
+      continue;
+    while(j < n && !bufs[j]->valid)
+      j++;
+    disk_submit(bufs + i, j - i, 0);
+    __sync_fetch_and_add(&bcache.ndread, 1);
+  }
+}
+
+// Wait for the reads bfillstart() started, one disk_wait() per
+// request on its first buffer: the disk finishes a run as a whole.
+static void
+bfillwait(struct buf **bufs, int n)
+{
+  int i, j;
+
+  for(i = 0; i < n; i = j){
+    j = i + 1;
+    if(bufs[i]->valid)
+      continue;
+    while(j < n && !bufs[j]->valid)
+      j++;
+    disk_wait(bufs[i]);
+    for(int k = i; k < j; k++)
+      bufs[k]->valid = 1;
+  }
+}
+
+// All the reads of a breadn() are in flight together.
+static void
+bfill(struct buf **bufs, int n)
+{
+  bfillstart(bufs, n);
+  bfillwait(bufs, n);
+}
+
+// Like bread, for the n (<= MAXBVEC) sectors starting at sectorno,
+// e.g. a whole cluster: the uncached ones go to the disk together.
+void
+breadn(uint dev, uint sectorno, int n, struct buf **bufs)
+{
+  __sync_fetch_and_add(&bcache.nread, n);
+  bgetn(dev, sectorno, n, bufs);
+  for(int i = 0; i < n; i++){
+    if(bufs[i]->valid && bufs[i]->ra){
+      __sync_fetch_and_add(&bcache.rahit, 1);
+      bufs[i]->ra = 0;
+    }
+  }
+  bfill(bufs, n);
+}
+
+// Mark b's contents as needing to go to disk.  Must be locked.
+// The write itself is deferred to the flusher, to bsync() or to
+// the recycling of b, so that repeated updates of the same sector
+// (e.g. a FAT sector during an append) cost a single disk write.
+// 延迟写：只标记为脏，由bflushd或回收时写回磁盘
 void 
 bwrite(struct buf *b) {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
-  disk_write(b);
+  __sync_fetch_and_add(&bcache.nwrite, 1);
+  b->valid = 1;   // e.g. a sector from bgetn() that was filled in
+  if(!b->dirty){
+    b->dirty = 1;
+    if(__sync_add_and_fetch(&bcache.ndirty, 1) == BDIRTY_HIGH)
+      bkick();
+  }
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Stamp it as the most recently used one if no one else holds it.
 void
 brelse(struct buf *b)
 {
@@ -136,34 +522,270 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
+  bunref(b, 1);
+}
 
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+// Release the run of buffers from breadn() or bgetn().
+void
+brelsen(struct buf **bufs, int n)
+{
+  for(int i = n - 1; i >= 0; i--)
+    brelse(bufs[i]);
+  bvecend();
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = &bcache.bucket[BHASH(b->dev, b->sectorno)];
+
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
-  b->refcnt--;
-  release(&bcache.lock);
+  bunref(b, 0);
+}
+
+// Pin the cached buffer of the sector if it looks dirty.
+static struct buf*
+bpindirty(uint dev, uint sectorno)
+{
+  struct bucket *bk = &bcache.bucket[BHASH(dev, sectorno)];
+  struct buf *b;
+
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, sectorno)) != 0 && b->dirty)
+    b->refcnt++;
+  else
+    b = 0;
+  release(&bk->lock);
+  return b;
+}
+
+// Collect the cache hit rate and lock contention counters.
+void
+bstat(struct iostat *st)
+{
+  struct bucket *bk;
+
+  st->bread = bcache.nread;
+  st->bhit = 0;
+  st->bmiss = bcache.miss;
+  st->bwrite = bcache.nwrite;
+  st->bwback = bcache.nwback;
+  st->dread = bcache.ndread;
+  st->dwrite = bcache.ndwrite;
+  st->ra = bcache.nra;
+  st->rahit = bcache.rahit;
+  st->rawaste = bcache.rawaste;
+  st->block = bcache.lock.nacquire;
+  st->bcontend = bcache.lock.ncontend;
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    st->bhit += bk->hit;
+    st->block += bk->lock.nacquire;
+    st->bcontend += bk->lock.ncontend;
+  }
+}
+
+// Write every dirty buffer back to disk, together with
+// the dirty buffers of the sectors that follow it.
+// Up to WBDEPTH requests are kept in flight.
+#define WBDEPTH 8
+#define WBBUFS  (NBUF / 2)   // buffers in flight at most
+
+// Finish the write-backs in flight.
+static void
+bsyncwait(struct buf **wb, int *head, int nreq, int nbuf)
+{
+  for(int i = 0; i < nreq; i++){
+    int end = (i + 1 < nreq) ? head[i + 1] : nbuf;
+    bflushdone(wb + head[i], end - head[i]);
+  }
+  for(int i = nbuf - 1; i >= 0; i--){
+    releasesleep(&wb[i]->lock);
+    bunpin(wb[i]);
+  }
+}
+
+void
+bsync(void)
+{
+  struct buf *bp, *b, *nb, *wb[WBBUFS];
+  int head[WBDEPTH];
+  int n, nreq, nbuf;
+  uint dev, sectorno;
+
+  nreq = nbuf = 0;
+  for(bp = bcache.buf; bp < bcache.buf+NBUF; bp++){
+    // only a hint: bp may be recycled at any moment, so look its
+    // sector up again under the bucket lock and pin what is found
+    dev = bp->dev;
+    sectorno = bp->sectorno;
+    if(!bp->dirty || (b = bpindirty(dev, sectorno)) == 0)
+      continue;
+    if(!tryacquiresleep(&b->lock)){
+      // never wait on a buffer while holding others:
+      // finish what is in flight first.
+      bsyncwait(wb, head, nreq, nbuf);
+      nreq = nbuf = 0;
+      acquiresleep(&b->lock);
+    }
+    if(!b->dirty || b->dev != dev || b->sectorno != sectorno){
+      // written back or recycled by someone else meanwhile
+      releasesleep(&b->lock);
+      bunpin(b);
+      continue;
+    }
+
+    // Take the followers that no one holds along.
+    head[nreq] = nbuf;
+    wb[nbuf++] = b;
+    for(n = 1; n < MAXBVEC; n++){
+      if((nb = bpindirty(dev, sectorno + n)) == 0)
+        break;
+      if(!tryacquiresleep(&nb->lock)){
+        bunpin(nb);
+        break;
+      }
+      if(!nb->dirty || nb->dev != dev || nb->sectorno != sectorno + n){
+        releasesleep(&nb->lock);
+        bunpin(nb);
+        break;
+      }
+      wb[nbuf++] = nb;
+    }
+    bflushstart(wb + head[nreq], n);
+    nreq++;
+
+    if(nreq == WBDEPTH || nbuf + MAXBVEC > WBBUFS){
+      bsyncwait(wb, head, nreq, nbuf);
+      nreq = nbuf = 0;
+    }
+  }
+  bsyncwait(wb, head, nreq, nbuf);
 }
 
+// Wake the flusher up. Called from the timer interrupt too.
+void
+bkick(void)
+{
+  acquire(&bcache.flushlock);
+  bcache.kick = 1;
+  wakeup(&bcache.kick);
+  release(&bcache.flushlock);
+}
+
+// Body of the flusher kernel thread: write dirty buffers
+// back whenever kicked by the timer or by bwrite().
+void
+bflushd(void)
+{
+  for(;;){
+    acquire(&bcache.flushlock);
+    while(!bcache.kick)
+      sleep(&bcache.kick, &bcache.flushlock);
+    bcache.kick = 0;
+    release(&bcache.flushlock);
+
+    bsync();
+  }
+}
+
+// Ask breadd to bring n sectors starting at sectorno into
+// the cache. Requests that do not fit in the queue are dropped,
+// read-ahead is only a hint.
+void
+breadahead(uint dev, uint sectorno, uint n)
+{
+  uint last;
 
+  if(n == 0)
+    return;
+  acquire(&raq.lock);
+  if(raq.head != raq.tail){
+    // extend the newest request if this one follows it.
+    last = (raq.tail - 1) % RAQSIZE;
+    if(raq.q[last].dev == dev && raq.q[last].sectorno + raq.q[last].n == sectorno){
+      raq.q[last].n += n;
+      release(&raq.lock);
+      return;
+    }
+  }
+  if(raq.tail - raq.head < RAQSIZE){
+    raq.q[raq.tail % RAQSIZE].dev = dev;
+    raq.q[raq.tail % RAQSIZE].sectorno = sectorno;
+    raq.q[raq.tail % RAQSIZE].n = n;
+    raq.tail++;
+    wakeup(&raq);
+  }
+  release(&raq.lock);
+}
+
+// Is the sector in the cache? Only a hint, as it can be
+// recycled as soon as the bucket lock is released.
+static int
+bcached(uint dev, uint sectorno)
+{
+  struct bucket *bk = &bcache.bucket[BHASH(dev, sectorno)];
+  int r;
+
+  acquire(&bk->lock);
+  r = (bfind(bk, dev, sectorno) != 0);
+  release(&bk->lock);
+  return r;
+}
+
+// Read the n (<= MAXBVEC) sectors starting at sectorno
+// into the cache on behalf of breadd.
+// One run at a time: breadd must never wait for a turn to hold
+// buffers while it holds some, as the breadn() callers that have
+// the other turns may be waiting for those very buffers. It takes
+// a single one of the NBVEC turns, so it can't crowd them out either.
+static void
+bprefetch(uint dev, uint sectorno, int n)
+{
+  struct buf *bufs[MAXBVEC];
+
+  bgetn(dev, sectorno, n, bufs);
+  for(int i = 0; i < n; i++){
+    if(!bufs[i]->valid){
+      bufs[i]->ra = 1;
+      __sync_fetch_and_add(&bcache.nra, 1);
+    }
+  }
+  bfill(bufs, n);
+  brelsen(bufs, n);
+}
+
+// Body of the read-ahead kernel thread.
+void
+breadd(void)
+{
+  uint dev, sectorno, n, i, j;
+
+  for(;;){
+    acquire(&raq.lock);
+    while(raq.head == raq.tail)
+      sleep(&raq, &raq.lock);
+    dev = raq.q[raq.head % RAQSIZE].dev;
+    sectorno = raq.q[raq.head % RAQSIZE].sectorno;
+    n = raq.q[raq.head % RAQSIZE].n;
+    raq.head++;
+    release(&raq.lock);
+
+    // never let read-ahead push out more than half of the cache.
+    if(n > NBUF / 2)
+      n = NBUF / 2;
+    // read each run of uncached sectors with one request.
+    for(i = 0; i < n; i = j){
+      j = i + 1;
+      if(bcached(dev, sectorno + i))
+        continue;
+      while(j < n && j - i < MAXBVEC && !bcached(dev, sectorno + j))
+        j++;
+      bprefetch(dev, sectorno + i, j - i);
+    }
+  }
+}
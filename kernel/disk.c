@@ -4,6 +4,7 @@
 #include "../libs/riscv.h"
 
 #include "../libs/buf.h"
+#include "../libs/ktrace.h"
 
 #ifndef QEMU
 #include "../libs/sdcard.h"
@@ -23,20 +24,76 @@ void disk_init(void)
 
 void disk_read(struct buf *b)
 {
+    ktrace(TR_DISKSUB, b->sectorno, 1);
     #ifdef QEMU
 	virtio_disk_rw(b, 0);
     #else 
 	sdcard_read_sector(b->data, b->sectorno);
 	#endif
+    ktrace(TR_DISKDONE, b->sectorno, 0);
 }
 
 void disk_write(struct buf *b)
 {
+    ktrace(TR_DISKSUB, b->sectorno, -1);
     #ifdef QEMU
 	virtio_disk_rw(b, 1);
     #else 
 	sdcard_write_sector(b->data, b->sectorno);
 	#endif
+    ktrace(TR_DISKDONE, b->sectorno, 0);
+}
+
+// Vectored requests: bufs[i] holds sector bufs[0]->sectorno + i,
+// and the whole run goes to the device as a single request.
+// The SD card driver has no multi-block transfer yet, so on
+// k210 the run is still moved one sector at a time.
+void disk_read_vec(struct buf **bufs, int n)
+{
+    ktrace(TR_DISKSUB, bufs[0]->sectorno, n);
+    #ifdef QEMU
+	virtio_disk_rwv(bufs, n, 0);
+    #else 
+	for (int i = 0; i < n; i++)
+		sdcard_read_sector(bufs[i]->data, bufs[i]->sectorno);
+	#endif
+    ktrace(TR_DISKDONE, bufs[0]->sectorno, 0);
+}
+
+void disk_write_vec(struct buf **bufs, int n)
+{
+    ktrace(TR_DISKSUB, bufs[0]->sectorno, -n);
+    #ifdef QEMU
+	virtio_disk_rwv(bufs, n, 1);
+    #else 
+	for (int i = 0; i < n; i++)
+		sdcard_write_sector(bufs[i]->data, bufs[i]->sectorno);
+	#endif
+    ktrace(TR_DISKDONE, bufs[0]->sectorno, 0);
+}
+
+// Asynchronous version of the above: start the request and return,
+// then disk_wait(bufs[0]) before touching or releasing the bufs, so
+// that a caller can keep several requests in flight.
+void disk_submit(struct buf **bufs, int n, int write)
+{
+    #ifdef QEMU
+    ktrace(TR_DISKSUB, bufs[0]->sectorno, write ? -n : n);
+	virtio_disk_submit(bufs, n, write);
+    #else 
+	if (write)
+		disk_write_vec(bufs, n);
+	else
+		disk_read_vec(bufs, n);
+	#endif
+}
+
+void disk_wait(struct buf *b)
+{
+    #ifdef QEMU
+	virtio_disk_wait(b);
+    ktrace(TR_DISKDONE, b->sectorno, 0);
+    #endif
 }
 
 void disk_intr(void)
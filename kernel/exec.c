@@ -33,6 +33,9 @@ loadseg(pagetable_t pagetable, uint64 va, struct dirent *ep, uint offset, uint s
       n = sz - i;
     else
       n = PGSIZE;
+    // start bringing in the next page while we copy this one.
+    if(i + PGSIZE < sz)
+      ereadahead(ep, offset + i + PGSIZE, PGSIZE);
     if(eread(ep, 0, (uint64)pa, offset+i, n) != n)
       return -1;
   }
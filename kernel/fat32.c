@@ -9,6 +9,11 @@
 #include "../libs/fat32.h"
 #include "../libs/string.h"
 #include "../libs/printf.h"
+#include "../libs/kalloc.h"
+#include "../libs/slab.h"
+#include "../libs/statfs.h"
+#include "../libs/iostat.h"
+#include "../libs/dirent64.h"
 
 /* fields that start with "_" are something we don't use */
 
@@ -58,17 +63,166 @@ static struct {
         uint32  tot_sec;            //总扇区数
         uint32  fat_sz;             //fat表的大小
         uint32  root_clus;          //根目录的簇号
+        uint16  fs_info;            //FSInfo扇区号
     } bpb;//0号扇区，存放文件系统的参数
 
 } fat;
 
+// FSInfo sector: a hint of the free cluster count and of where
+// to look for the next free cluster, so that neither needs a FAT
+// scan at mount time. Written back lazily, see fsinfo_sync().
+#define FSI_LEAD_SIG        0x41615252
+#define FSI_STRUC_SIG       0x61417272
+#define FSI_TRAIL_SIG       0xaa550000
+#define FSI_UNKNOWN         0xffffffff
+#define FSI_DELAY           64          // changes before writing FSInfo back
+
+static struct {
+    int     valid;                      // the volume has a good FSInfo sector
+    uint32  nchange;                    // changes not written back yet
+} fsinfo;
+
+// Free-cluster bitmap, one bit per cluster (1 = in use), so that
+// alloc_clus() never has to scan the FAT. A page of it covers
+// CLUS_PER_MAP clusters and is filled in from the FAT the first
+// time the next-fit cursor reaches it, which keeps mounting fast
+// and memory use small on big cards.
+#define CLUS_PER_MAP    (PGSIZE * 8)
+#define NCLUSMAP        256             // 8M clusters
+
+static struct {
+    struct sleeplock lock;
+    uint32  npage;
+    uint8   *map[NCLUSMAP];             // 0 until filled in
+    uint32  nfree[NCLUSMAP];            // free clusters in each filled page
+    uint32  next;                       // next-fit cursor
+    uint32  free;                       // free clusters, FSI_UNKNOWN if not known
+} clusmap;
+
+// The entry cache starts with ENTRY_CACHE_NUM entries, and takes a page
+// of extra ones whenever all are in use. ecache_shrink() gives the extra
+// pages back when memory runs low. Valid entries are hashed by parent
+// and name, so eget() doesn't compare names along the whole LRU list.
+#define NEHASH          64
+#define EPAGE_NENT      ((PGSIZE - sizeof(void *)) / sizeof(struct dirent))
+
+struct epage {
+    struct epage *next;
+    struct dirent entries[EPAGE_NENT];
+};
+
 static struct entry_cache {
     struct spinlock lock;
     struct dirent entries[ENTRY_CACHE_NUM];
+    struct epage *pages;                    // extra entries
+    struct dirent *hash[NEHASH];
+    uint32 nexteid;
 } ecache;
 
+/**
+ * Negative lookup cache: names recently found missing from a directory,
+ * so that repeated misses, such as sh searching PATH, don't look through
+ * the directory each time. A directory is known by its first cluster.
+ * emake() forgets the name it writes, and etrunc() forgets everything
+ * about a directory it frees. Only names up to NC_NAMELEN are kept.
+ */
+#define NNCACHE         64
+#define NC_NAMELEN      31
+
+static struct {
+    struct spinlock lock;
+    struct {
+        uint8   dev;
+        uint32  dclus;          // first cluster of the directory, 0 if the slot is unused
+        uint32  hash;
+        char    name[NC_NAMELEN + 1];
+    } ent[NNCACHE];
+    int hand;                   // next slot to replace
+} ncache;
+
 static struct dirent root;
 
+static void clusmap_load(uint32 p);
+
+/**
+ * Take the free cluster count and next free cluster hints from
+ * the FSInfo sector, if the volume has a good one.
+ */
+static void fsinfo_load(void)
+{
+    struct buf *b;
+    uint32 free, next;
+
+    fsinfo.valid = 0;
+    fsinfo.nchange = 0;
+    if (fat.bpb.fs_info == 0 || fat.bpb.fs_info == 0xffff || fat.bpb.fs_info >= fat.bpb.rsvd_sec_cnt)
+        return;
+    b = bread(0, fat.bpb.fs_info);
+    if (*(uint32 *)(b->data) == FSI_LEAD_SIG && *(uint32 *)(b->data + 484) == FSI_STRUC_SIG
+        && *(uint32 *)(b->data + 508) == FSI_TRAIL_SIG) {
+        fsinfo.valid = 1;
+        free = *(uint32 *)(b->data + 488);
+        next = *(uint32 *)(b->data + 492);
+        if (free <= fat.data_clus_cnt)
+            clusmap.free = free;
+        if (next >= 2 && next < fat.data_clus_cnt + 2)
+            clusmap.next = next;
+    }
+    brelse(b);
+}
+
+/**
+ * Put the current counts into the FSInfo sector's buffer;
+ * the buffer cache takes them to disk.
+ * Caller must hold clusmap.lock.
+ */
+static void fsinfo_sync(void)
+{
+    struct buf *b;
+
+    if (!fsinfo.valid || fsinfo.nchange == 0)
+        return;
+    b = bread(0, fat.bpb.fs_info);
+    *(uint32 *)(b->data + 488) = clusmap.free;
+    *(uint32 *)(b->data + 492) = clusmap.next;
+    bwrite(b);
+    brelse(b);
+    fsinfo.nchange = 0;
+}
+
+// A cluster was taken or given back.
+// Caller must hold clusmap.lock.
+static void fsinfo_change(void)
+{
+    if (++fsinfo.nchange >= FSI_DELAY)
+        fsinfo_sync();
+}
+
+/**
+ * Set up a fresh ecache entry and put it at the cold end of the LRU list.
+ * Caller must hold ecache.lock once the cache is in use.
+ */
+static void einit(struct dirent *de)
+{
+    de->dev = 0;
+    de->valid = 0;
+    de->ref = 0;
+    de->dirty = 0;
+    de->parent = 0;
+    de->ext = 0;
+    de->ext_max = de->ext_cnt = de->ext_clus = 0;
+    de->res_cnt = 0;
+    de->pend_cnt = 0;
+    de->dix = 0;
+    de->hnext = 0;
+    de->hidx = -1;
+    initsleeplock(&de->lock, "entry");
+    de->next = &root;
+    de->prev = root.prev;
+    root.prev->next = de;
+    root.prev = de;
+}
+
 /**
  * Read the Boot Parameter Block.
  * @return  0       if success
@@ -96,6 +250,7 @@ int fat32_init()
     fat.bpb.tot_sec = *(uint32 *)(b->data + 32);
     fat.bpb.fat_sz = *(uint32 *)(b->data + 36);
     fat.bpb.root_clus = *(uint32 *)(b->data + 44);
+    fat.bpb.fs_info = *(uint16 *)(b->data + 48);
 
     //计算出文件系统的第一个数据扇区的扇区号=（保留扇区+fat表数量*fat表大小）
     fat.first_data_sec = fat.bpb.rsvd_sec_cnt + fat.bpb.fat_cnt * fat.bpb.fat_sz;
@@ -121,8 +276,18 @@ int fat32_init()
     if (BSIZE != fat.bpb.byts_per_sec) 
         panic("byts_per_sec != BSIZE");
 
+    //空闲簇位图，按需从fat表中建立
+    initsleeplock(&clusmap.lock, "clusmap");
+    clusmap.npage = (fat.data_clus_cnt + 2 + CLUS_PER_MAP - 1) / CLUS_PER_MAP;
+    if (clusmap.npage > NCLUSMAP)
+        panic("fat32_init: too many clusters");
+    clusmap.next = 2;
+    clusmap.free = FSI_UNKNOWN;
+    fsinfo_load();
+
     //为ecache添加一个互斥锁
     initlock(&ecache.lock, "ecache");
+    initlock(&ncache.lock, "ncache");
 
     //把根目录清零
     memset(&root, 0, sizeof(root));
@@ -136,18 +301,12 @@ int fat32_init()
     root.valid = 1;
     root.prev = &root;
     root.next = &root;
+    root.hidx = -1;
+    ecache.pages = 0;
+    ecache.nexteid = 1;             // root has eid 0
     //初始化ecache数组（文件集合）
     for(struct dirent *de = ecache.entries; de < ecache.entries + ENTRY_CACHE_NUM; de++) {
-        de->dev = 0;
-        de->valid = 0;
-        de->ref = 0;
-        de->dirty = 0;
-        de->parent = 0;
-        de->next = root.next;
-        de->prev = &root;
-        initsleeplock(&de->lock, "entry");
-        root.next->prev = de;
-        root.next = de;
+        einit(de);
     }
     return 0;
 }
@@ -206,6 +365,22 @@ static uint32 read_fat(uint32 cluster)
     return next_clus;
 }
 
+/**
+ * Mark FAT1 sector b, numbered sec, dirty and copy it to the other FATs.
+ * The copies are taken without reading them, as they are overwritten.
+ */
+static void fat_write_sec(struct buf *b, uint32 sec)
+{
+    struct buf *m;
+    bwrite(b);
+    for (int i = 1; i < fat.bpb.fat_cnt; i++) {
+        m = bgetw(0, sec + i * fat.bpb.fat_sz);
+        memmove(m->data, b->data, BSIZE);
+        bwrite(m);
+        brelse(m);
+    }
+}
+
 /**
  * Write the FAT region content corresponded to the given cluster number.
  * @param   cluster     the number of cluster to write its content in FAT table
@@ -222,60 +397,244 @@ static int write_fat(uint32 cluster, uint32 content)
     uint off = fat_offset_of_clus(cluster);
     //下面两行代码是将content中的内容写到b的扇区号里
     *(uint32 *)(b->data + off) = content;
-    bwrite(b);
+    fat_write_sec(b, fat_sec);
     
     brelse(b);
     return 0;
 }
 
 //清零簇中的数据，并写入到磁盘中
+//整簇的扇区一起取得，不必先从磁盘读出；写回时也合并为一个请求
 static void zero_clus(uint32 cluster)
 {
     uint32 sec = first_sec_of_clus(cluster);
+    struct buf *bufs[MAXBVEC];
+    for (int i = 0, k; i < fat.bpb.sec_per_clus; i += k, sec += k) {
+        k = fat.bpb.sec_per_clus - i;
+        if (k > MAXBVEC)
+            k = MAXBVEC;
+        bgetn(0, sec, k, bufs);
+        for (int j = 0; j < k; j++) {
+            memset(bufs[j]->data, 0, BSIZE);
+            bwrite(bufs[j]);
+        }
+        brelsen(bufs, k);
+    }
+}
+
+// Zero n bytes from off of the cluster. Sectors it covers whole aren't read first.
+static void zero_clus_part(uint32 cluster, uint off, uint n)
+{
+    if (off == 0 && n == fat.byts_per_clus) {
+        zero_clus(cluster);
+        return;
+    }
+    uint32 sec = first_sec_of_clus(cluster) + off / BSIZE;
     struct buf *b;
-    for (int i = 0; i < fat.bpb.sec_per_clus; i++) {
-        b = bread(0, sec++);
-        memset(b->data, 0, BSIZE);
+    for (uint m; n > 0; n -= m, off += m, sec++) {
+        m = BSIZE - off % BSIZE;
+        if (n < m)
+            m = n;
+        b = m == BSIZE ? bgetw(0, sec) : bread(0, sec);
+        memset(b->data + off % BSIZE, 0, m);
         bwrite(b);
         brelse(b);
     }
 }
 
-//从dev中分配一个簇
-static uint32 alloc_clus(uint8 dev)
+// Fill in page p of the free-cluster bitmap from FAT1.
+// Caller must hold clusmap.lock.
+static void clusmap_load(uint32 p)
 {
-    // should we keep a free cluster list? instead of searching fat every time.
-    struct buf *b;
-    uint32 sec = fat.bpb.rsvd_sec_cnt;
-
-    //每个扇区的表项数
-    uint32 const ent_per_sec = fat.bpb.byts_per_sec / sizeof(uint32);
-
-    //遍历fat表
-    for (uint32 i = 0; i < fat.bpb.fat_sz; i++, sec++) {
-        //读取dev中的sec保存到一个buffer中并返回到b
-        b = bread(dev, sec);
-        //遍历buffer中所有表项
-        for (uint32 j = 0; j < ent_per_sec; j++) {
-            //如果未分配，初始化该簇并返回
-            if (((uint32 *)(b->data))[j] == 0) {
-                ((uint32 *)(b->data))[j] = FAT32_EOC + 7;
-                bwrite(b);
+    uint8 *m;
+    struct buf *bufs[MAXBVEC];
+    uint32 const ent_per_sec = BSIZE / sizeof(uint32);
+    uint32 const c0 = p * CLUS_PER_MAP;
+    uint32 const cend = fat.data_clus_cnt + 2;  // clusters [2, cend) exist
+    uint32 nfree = 0;
+
+    if ((m = kalloc()) == 0)
+        panic("clusmap_load");
+    memset(m, 0xff, PGSIZE);
+    uint32 sec = fat_sec_of_clus(c0, 1);
+    uint32 nsec = CLUS_PER_MAP / ent_per_sec;
+    if (c0 + CLUS_PER_MAP > cend)
+        nsec = (cend - c0 + ent_per_sec - 1) / ent_per_sec;
+    for (uint32 i = 0, k; i < nsec; i += k) {
+        k = nsec - i < MAXBVEC ? nsec - i : MAXBVEC;
+        breadn(0, sec + i, k, bufs);
+        for (uint32 j = 0; j < k * ent_per_sec; j++) {
+            uint32 c = c0 + i * ent_per_sec + j;
+            uint32 ent = ((uint32 *)bufs[j / ent_per_sec]->data)[j % ent_per_sec];
+            if (c >= 2 && c < cend && (ent & 0x0fffffff) == 0) {
+                m[(c - c0) / 8] &= ~(1 << (c % 8));
+                nfree++;
+            }
+        }
+        brelsen(bufs, k);
+    }
+    clusmap.map[p] = m;
+    clusmap.nfree[p] = nfree;
+}
+
+// Find a free cluster at or after the next-fit cursor, wrapping
+// around once, and mark it in use. Return 0 if the volume is full.
+// With empty set, only take the first of 8 free clusters in a row
+// (a zero bitmap byte), so that a run can grow from it.
+// Caller must hold clusmap.lock.
+static uint32 clusmap_take(int empty)
+{
+    uint32 p = clusmap.next / CLUS_PER_MAP;
+    uint32 from = (clusmap.next % CLUS_PER_MAP) / 8;
+
+    for (uint32 n = 0; n <= clusmap.npage; n++, p = (p + 1) % clusmap.npage, from = 0) {
+        if (clusmap.map[p] == 0)
+            clusmap_load(p);
+        if (clusmap.nfree[p] == 0)
+            continue;
+        uint8 *m = clusmap.map[p];
+        for (uint32 i = from; i < PGSIZE; i++) {
+            if (empty ? m[i] != 0 : m[i] == 0xff)
+                continue;
+            int bit = 0;
+            while (m[i] & (1 << bit))
+                bit++;
+            m[i] |= 1 << bit;
+            clusmap.nfree[p]--;
+            uint32 c = p * CLUS_PER_MAP + i * 8 + bit;
+            clusmap.next = c + 1 < fat.data_clus_cnt + 2 ? c + 1 : 2;
+            if (clusmap.free != FSI_UNKNOWN)
+                clusmap.free--;
+            fsinfo_change();
+            return c;
+        }
+    }
+    return 0;
+}
+
+// Take the clusters after c, which the caller has just taken, as long
+// as they are free and on the same bitmap page, up to n in all.
+// Returns how many were taken, counting c. Caller must hold clusmap.lock.
+static uint32 clusmap_extend(uint32 c, uint32 n)
+{
+    uint32 const p = c / CLUS_PER_MAP;
+    uint32 const cend = fat.data_clus_cnt + 2;
+    uint8 *m = clusmap.map[p];
+    uint32 got = 1;
+
+    for (uint32 x = c + 1; got < n && x < cend && x / CLUS_PER_MAP == p; x++, got++) {
+        uint8 *byte = &m[(x % CLUS_PER_MAP) / 8];
+        if (*byte & (1 << (x % 8)))
+            break;
+        *byte |= 1 << (x % 8);
+    }
+    clusmap.nfree[p] -= got - 1;
+    if (clusmap.free != FSI_UNKNOWN)
+        clusmap.free -= got - 1;
+    clusmap.next = c + got < cend ? c + got : 2;
+    return got;
+}
+
+// Mark cluster c free in the bitmap. Caller must hold clusmap.lock.
+static void clusmap_put(uint32 c)
+{
+    uint32 p = c / CLUS_PER_MAP;
+    uint8 *m = clusmap.map[p];
+    // an unfilled page picks the change up from the FAT.
+    if (m != 0 && (m[(c % CLUS_PER_MAP) / 8] & (1 << (c % 8)))) {
+        m[(c % CLUS_PER_MAP) / 8] &= ~(1 << (c % 8));
+        clusmap.nfree[p]++;
+    }
+}
+
+// Free the n clusters from c, which are in the bitmap but not in the FAT.
+static void clusmap_release(uint32 c, uint32 n)
+{
+    acquiresleep(&clusmap.lock);
+    for (uint32 i = 0; i < n; i++)
+        clusmap_put(c + i);
+    if (clusmap.free != FSI_UNKNOWN)
+        clusmap.free += n;
+    fsinfo_change();
+    releasesleep(&clusmap.lock);
+}
+
+//分配一段连续的簇，最多want个，首簇号写入返回值，个数写入*got
+//要多个簇时先找8个连续空闲簇的起点，找不到再退回任意空闲簇
+//只改位图，fat表由调用者写入；卷满时返回0
+static uint32 alloc_run(uint32 want, uint32 *got)
+{
+    uint32 c = 0;
+    acquiresleep(&clusmap.lock);
+    if (want > 1)
+        c = clusmap_take(1);
+    if (c == 0)
+        c = clusmap_take(0);
+    *got = c ? clusmap_extend(c, want) : 0;
+    releasesleep(&clusmap.lock);
+    return c;
+}
+
+// Chain the n clusters from c to each other in the FAT, the last
+// one ending the chain, writing each FAT sector once.
+static void fat_link_run(uint32 c, uint32 n)
+{
+    struct buf *b = 0;
+    uint32 sec = 0;
+    for (uint32 x = c; x < c + n; x++) {
+        uint32 s = fat_sec_of_clus(x, 1);
+        if (b == 0 || s != sec) {
+            if (b != 0) {
+                fat_write_sec(b, sec);
                 brelse(b);
-                uint32 clus = i * ent_per_sec + j;
-                zero_clus(clus);
-                return clus;
             }
+            b = bread(0, s);
+            sec = s;
         }
+        *(uint32 *)(b->data + fat_offset_of_clus(x)) = x + 1 < c + n ? x + 1 : FAT32_EOC + 7;
+    }
+    if (b != 0) {
+        fat_write_sec(b, sec);
         brelse(b);
     }
-    panic("no clusters");
 }
 
-//清空簇
-static void free_clus(uint32 cluster)
+//释放从cluster开始的整条簇链
+//按fat扇区合并修改：链上落在同一扇区的表项都清零后，该扇区只写一次（连同fat2）
+static void free_chain(uint32 cluster)
 {
-    write_fat(cluster, 0);
+    struct buf *b = 0;
+    uint32 sec = 0, nfreed = 0;
+
+    acquiresleep(&clusmap.lock);
+    while (cluster >= 2 && cluster < FAT32_EOC && cluster <= fat.data_clus_cnt + 1) {
+        uint32 s = fat_sec_of_clus(cluster, 1);
+        if (b == 0 || s != sec) {
+            if (b != 0) {
+                fat_write_sec(b, sec);
+                brelse(b);
+            }
+            b = bread(0, s);
+            sec = s;
+        }
+        uint32 *ent = (uint32 *)(b->data + fat_offset_of_clus(cluster));
+        uint32 next = *ent;
+        *ent = 0;
+        clusmap_put(cluster);
+        nfreed++;
+        cluster = next;
+    }
+    if (b != 0) {
+        fat_write_sec(b, sec);
+        brelse(b);
+    }
+    // only clusters of a chain get here, so they were in use.
+    if (nfreed > 0) {
+        if (clusmap.free != FSI_UNKNOWN)
+            clusmap.free += nfreed;
+        fsinfo_change();
+    }
+    releasesleep(&clusmap.lock);
 }
 
 //对簇进行读写,从off开始的n个字节
@@ -284,38 +643,280 @@ static uint rw_clus(uint32 cluster, int write, int user, uint64 data, uint off,
     if (off + n > fat.byts_per_clus)
         panic("offset out of range");
     uint tot, m;
-    struct buf *bp;
+    struct buf *bufs[MAXBVEC], *bp;
     //利用簇和偏移获得对应的扇区号
     uint sec = first_sec_of_clus(cluster) + off / fat.bpb.byts_per_sec;
     off = off % fat.bpb.byts_per_sec;
+    //涉及的扇区数，一次取MAXBVEC个，未缓存的合并成一个磁盘请求
+    int nsec = n == 0 ? 0 : (off + n + BSIZE - 1) / BSIZE;
 
     int bad = 0;
-    for (tot = 0; tot < n; tot += m, off += m, data += m, sec++) {
-        // 读取sec内的内容
-        bp = bread(0, sec);
-        // m为剩余大小
-        m = BSIZE - off % BSIZE;
-        
-        if (n - tot < m) {
-            m = n - tot;
+    tot = 0;
+    for (int k; nsec > 0 && bad != -1; nsec -= k, sec += k) {
+        k = nsec < MAXBVEC ? nsec : MAXBVEC;
+        // 读取这些扇区的内容；要整个覆盖的扇区不必先读
+        if (write && off % BSIZE == 0 && n - tot >= k * BSIZE) {
+            bgetn(0, sec, k, bufs);
+        } else {
+            breadn(0, sec, k, bufs);
         }
-        if (write) {
-            // 写入操作
-            // either_copyin根据第二个参数判断从用户地址复制还是从内核地址复制到bp->data
-            if ((bad = either_copyin(bp->data + (off % BSIZE), user, data, m)) != -1) {
-                bwrite(bp);
+        for (int i = 0; i < k; i++, tot += m, off += m, data += m) {
+            bp = bufs[i];
+            // m为剩余大小
+            m = BSIZE - off % BSIZE;
+            
+            if (n - tot < m) {
+                m = n - tot;
             }
+            if (write) {
+                // 写入操作
+                // either_copyin根据第二个参数判断从用户地址复制还是从内核地址复制到bp->data
+                if ((bad = either_copyin(bp->data + (off % BSIZE), user, data, m)) != -1) {
+                    bwrite(bp);
+                }
+            } else {
+                // 复制到第二个参数，源是第三个参数
+                bad = either_copyout(user, data, bp->data + (off % BSIZE), m);
+            }
+            if (bad == -1) {
+                break;
+            }
+        }
+        // 释放这些buffer
+        brelsen(bufs, k);
+    }
+    return tot;
+}
+
+/**
+ * Clusters a file appends to are not linked into the FAT right away.
+ * They are kept as a pending run, [pend_clus, pend_clus + pend_cnt),
+ * that follows cluster pend_prev (0 if the run starts the chain), and
+ * are linked in one go by epend_flush() when the entry is written back
+ * (eupdate()), together with the new file size. Until then, walks of
+ * the chain go through eclus_next().
+ */
+
+// The cluster after clus in the chain of entry, pending ones included.
+static uint32 eclus_next(struct dirent *entry, uint32 clus)
+{
+    if (entry->pend_cnt != 0) {
+        uint32 pend_end = entry->pend_clus + entry->pend_cnt;
+        if (entry->pend_prev != 0 && clus == entry->pend_prev)
+            return entry->pend_clus;
+        if (clus >= entry->pend_clus && clus < pend_end)
+            return clus + 1 < pend_end ? clus + 1 : FAT32_EOC + 7;
+    }
+    return read_fat(clus);
+}
+
+/**
+ * Extent map: the cluster chain of a file as runs of contiguous clusters,
+ * so that reloc_clus() can jump to any offset with a binary search
+ * instead of walking the FAT from first_clus. It is built on the first
+ * jump and grown as far as needed, reading each FAT entry once. Appends
+ * only add clusters past what it covers; etrunc() drops it.
+ * Most files are a run or two, so the map starts small in kmalloc()
+ * and doubles, ending up in a page of its own.
+ */
+#define EXT_MIN 4
+#define NEXTENT (PGSIZE / sizeof(struct extent))
+#define EXT_ISPAGE(n) ((n) * sizeof(struct extent) > KMALLOC_MAX)
+
+// Free the extent map of entry. Returns the number of pages freed.
+static int eext_free(struct dirent *entry)
+{
+    int n = 0;
+
+    if (entry->ext) {
+        if (EXT_ISPAGE(entry->ext_max)) {
+            kfree(entry->ext);
+            n = 1;
         } else {
-            // 复制到第二个参数，源是第三个参数
-            bad = either_copyout(user, data, bp->data + (off % BSIZE), m);
+            kmfree(entry->ext);
         }
-        // 释放bp的一个引用
-        brelse(bp);
-        if (bad == -1) {
-            break;
+        entry->ext = 0;
+    }
+    entry->ext_max = 0;
+    entry->ext_cnt = 0;
+    entry->ext_clus = 0;
+    return n;
+}
+
+// Make room for one more extent in the map of entry.
+static int eext_more(struct dirent *entry)
+{
+    uint32 max = entry->ext_max ? entry->ext_max * 2 : EXT_MIN;
+    struct extent *ext;
+
+    if (entry->ext_max == NEXTENT)
+        return -1;
+    if (EXT_ISPAGE(max))
+        max = NEXTENT;
+    ext = EXT_ISPAGE(max) ? kalloc() : kmalloc(max * sizeof(struct extent));
+    if (ext == 0)
+        return -1;
+    if (entry->ext) {
+        memmove(ext, entry->ext, entry->ext_cnt * sizeof(struct extent));
+        kmfree(entry->ext);     // never a page: that is the last size
+    }
+    entry->ext = ext;
+    entry->ext_max = max;
+    return 0;
+}
+
+// Grow the extent map of entry until it covers the cluster numbered
+// lclus in the file, or the whole chain. Return -1 if it can't.
+static int eext_grow(struct dirent *entry, uint32 lclus)
+{
+    struct extent *e;
+    uint32 clus;
+
+    if (entry->ext == 0) {
+        entry->ext_max = 0;
+        entry->ext_cnt = 0;
+        entry->ext_clus = 0;
+    }
+    if (entry->ext_cnt == 0) {
+        clus = entry->first_clus;
+    } else {
+        e = &entry->ext[entry->ext_cnt - 1];
+        clus = eclus_next(entry, e->pclus + e->len - 1);
+    }
+    while (entry->ext_clus <= lclus && clus >= 2 && clus < FAT32_EOC) {
+        e = entry->ext_cnt ? &entry->ext[entry->ext_cnt - 1] : 0;
+        if (e && e->pclus + e->len == clus) {
+            e->len++;
+        } else {
+            if (entry->ext_cnt == entry->ext_max && eext_more(entry) < 0)
+                return -1;
+            e = &entry->ext[entry->ext_cnt++];
+            e->lclus = entry->ext_clus;
+            e->pclus = clus;
+            e->len = 1;
         }
+        entry->ext_clus++;
+        clus = eclus_next(entry, clus);
     }
-    return tot;
+    return 0;
+}
+
+// Return the disk cluster of the cluster numbered lclus in the file,
+// or 0 if it is past the end of the chain or the map can't be grown.
+static uint32 eext_lookup(struct dirent *entry, uint32 lclus)
+{
+    if (lclus >= entry->ext_clus && eext_grow(entry, lclus) < 0)
+        return 0;
+    if (lclus >= entry->ext_clus)
+        return 0;
+    // the last extent that starts at or before lclus
+    int lo = 0, hi = entry->ext_cnt - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (entry->ext[mid].lclus <= lclus)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return entry->ext[lo].pclus + (lclus - entry->ext[lo].lclus);
+}
+
+/**
+ * Cluster runs: a file that grows takes a run of ERESERVE clusters in
+ * a row, uses the first and keeps the rest reserved for its next
+ * appends, so that files written side by side don't interleave on
+ * disk. The reservation is only marked in the free bitmap, not in the
+ * FAT, and is handed back by etrunc() and the last eput().
+ * Caller must hold entry->lock.
+ */
+#define ERESERVE    16
+
+// Take a run of up to want clusters for the chain of entry,
+// from its reservation if any. Returns the first cluster and the
+// count in *n, or 0 if the volume is full.
+static uint32 erun_take(struct dirent *entry, uint32 want, uint32 *n)
+{
+    uint32 c;
+    if (entry->res_cnt == 0) {
+        uint32 ask = want;
+        if (ask < ERESERVE && !(entry->attribute & ATTR_DIRECTORY))
+            ask = ERESERVE;
+        if ((c = alloc_run(ask, n)) == 0)
+            return 0;
+        entry->res_clus = c;
+        entry->res_cnt = *n;
+    }
+    *n = want < entry->res_cnt ? want : entry->res_cnt;
+    c = entry->res_clus;
+    entry->res_clus += *n;
+    entry->res_cnt -= *n;
+    return c;
+}
+
+// Put the run of n clusters from c after cluster last of the chain
+// of entry, or make it the chain if last is 0.
+static void erun_link(struct dirent *entry, uint32 last, uint32 c, uint32 n)
+{
+    fat_link_run(c, n);
+    if (last != 0) {
+        write_fat(last, c);
+    } else {
+        entry->first_clus = c;
+        entry->dirty = 1;
+    }
+}
+
+// Give the clusters entry has reserved but not used back.
+static void eres_release(struct dirent *entry)
+{
+    if (entry->res_cnt == 0)
+        return;
+    clusmap_release(entry->res_clus, entry->res_cnt);
+    entry->res_cnt = 0;
+}
+
+// Link the pending run of entry into the FAT.
+static void epend_flush(struct dirent *entry)
+{
+    if (entry->pend_cnt == 0)
+        return;
+    fat_link_run(entry->pend_clus, entry->pend_cnt);
+    if (entry->pend_prev != 0)
+        write_fat(entry->pend_prev, entry->pend_clus);
+    entry->pend_cnt = 0;
+}
+
+// Add a run of up to want clusters to the end of the chain of entry,
+// whose last cluster is entry->cur_clus (if it has any). A directory
+// gets them zeroed and linked at once, as enext() stops at an empty
+// slot. A file gets them as pending and not zeroed: nothing past
+// file_size is ever read, and ewrite() can't start past it, so bytes
+// there only become visible by being written (see efalloc()).
+// Returns the first cluster of the run, 0 if the volume is full.
+static uint32 egrow(struct dirent *entry, uint32 want)
+{
+    uint32 c, n;
+    uint32 last = entry->first_clus ? entry->cur_clus : 0;
+
+    if ((c = erun_take(entry, want, &n)) == 0)
+        return 0;
+    if (entry->attribute & ATTR_DIRECTORY) {
+        for (uint32 i = 0; i < n; i++)
+            zero_clus(c + i);
+        erun_link(entry, last, c, n);
+        return c;
+    }
+    if (entry->pend_cnt != 0 && c != entry->pend_clus + entry->pend_cnt)
+        epend_flush(entry);         // not contiguous, start a new pending run
+    if (entry->pend_cnt == 0) {
+        entry->pend_prev = last;
+        entry->pend_clus = c;
+        if (last == 0)
+            entry->first_clus = c;
+    }
+    entry->pend_cnt += n;
+    entry->dirty = 1;
+    return c;
 }
 
 /**
@@ -330,15 +931,26 @@ static int reloc_clus(struct dirent *entry, uint off, int alloc)
 {
     // 计算出偏移处簇的数量
     int clus_num = off / fat.byts_per_clus;
+    uint32 clus;
+    // 跳转（而不是移到下一簇）时查extent表
+    if (entry->first_clus != 0 && clus_num != entry->clus_cnt && clus_num != entry->clus_cnt + 1) {
+        if ((clus = eext_lookup(entry, clus_num)) != 0) {
+            entry->cur_clus = clus;
+            entry->clus_cnt = clus_num;
+        } else if (clus_num > entry->clus_cnt && entry->ext_clus > entry->clus_cnt + 1
+                   && (clus = eext_lookup(entry, entry->ext_clus - 1)) != 0) {
+            // past the end of the chain: start from its last cluster
+            entry->cur_clus = clus;
+            entry->clus_cnt = entry->ext_clus - 1;
+        }
+    }
     // 如果大于，则一直分配到偏移
     while (clus_num > entry->clus_cnt) {
         // 根据当前簇号返回下一个簇号clus
-        int clus = read_fat(entry->cur_clus);
+        clus = eclus_next(entry, entry->cur_clus);
         if (clus >= FAT32_EOC) {
-            if (alloc) {
-                clus = alloc_clus(entry->dev);
-                //分配完新簇后写入到当前cur_clus
-                write_fat(entry->cur_clus, clus);
+            if (alloc && (clus = egrow(entry, clus_num - entry->clus_cnt)) != 0) {
+                //分配完新簇后接到当前cur_clus之后，一次接上够到off的一段
             } else {
                 entry->cur_clus = entry->first_clus;
                 entry->clus_cnt = 0;
@@ -355,7 +967,7 @@ static int reloc_clus(struct dirent *entry, uint off, int alloc)
         entry->cur_clus = entry->first_clus;
         entry->clus_cnt = 0;
         while (entry->clus_cnt < clus_num) {
-            entry->cur_clus = read_fat(entry->cur_clus);
+            entry->cur_clus = eclus_next(entry, entry->cur_clus);
             if (entry->cur_clus >= FAT32_EOC) {
                 panic("reloc_clus");
             }
@@ -399,6 +1011,57 @@ int eread(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n)
     return tot;
 }
 
+/**
+ * Queue the sectors backing [off, off + n) of a file for read-ahead.
+ * Only walks forward from the entry's cluster cursor, so it costs a few
+ * (normally cached) FAT lookups and never waits for the data itself.
+ * Caller must hold entry->lock.
+ */
+// 预读：把文件[off, off + n)对应的扇区交给breadd异步读入缓存
+void ereadahead(struct dirent *entry, uint off, uint n)
+{
+    if ((entry->attribute & ATTR_DIRECTORY) || off >= entry->file_size || n == 0) {
+        return;
+    }
+    if (off + n > entry->file_size || off + n < off) {
+        n = entry->file_size - off;
+    }
+    uint32 clus = entry->cur_clus;
+    uint i = entry->clus_cnt;
+    if (clus < 2 || clus >= FAT32_EOC || off / fat.byts_per_clus < i) {
+        return;         // the cursor is past off, don't walk the chain from the start
+    }
+    // file-relative sector numbers
+    uint const spc = fat.bpb.sec_per_clus;
+    uint first = off / BSIZE;
+    uint last = (off + n - 1) / BSIZE;
+    for (; i * spc <= last && clus >= 2 && clus < FAT32_EOC; i++) {
+        uint lo = first > i * spc ? first : i * spc;
+        uint hi = last < (i + 1) * spc - 1 ? last : (i + 1) * spc - 1;
+        if (lo <= hi) {
+            breadahead(entry->dev, first_sec_of_clus(clus) + lo - i * spc, hi - lo + 1);
+        }
+        clus = eclus_next(entry, clus);
+    }
+}
+
+/**
+ * Several open files of the same entry each keep their own position in
+ * the cluster chain, and put it into entry->cur_clus/clus_cnt before
+ * using the entry (see struct file). A position saved before the chain
+ * was freed is stale, and gives way to the start of the chain.
+ * Caller must hold entry->lock.
+ */
+void ecursor_load(struct dirent *entry, uint32 clus, uint cnt, uint32 gen)
+{
+    if (clus == 0 || gen != entry->clus_gen) {
+        clus = entry->first_clus;
+        cnt = 0;
+    }
+    entry->cur_clus = clus;
+    entry->clus_cnt = cnt;
+}
+
 // Caller must hold entry->lock.
 // 向entry里写数据
 // 给定entry，将off起始的n个字节写到dst处
@@ -410,13 +1073,18 @@ int ewrite(struct dirent *entry, int user_src, uint64 src, uint off, uint n)
     }
     // 如果文件大小为0，则新分配一个簇
     if (entry->first_clus == 0) {   // so file_size if 0 too, which requests off == 0
-        entry->cur_clus = entry->first_clus = alloc_clus(entry->dev);
+        uint32 clus;
+        if ((clus = egrow(entry, 1)) == 0) {
+            return -1;              // volume full
+        }
+        entry->cur_clus = clus;
         entry->clus_cnt = 0;
-        entry->dirty = 1;
     }
     uint tot, m;
     for (tot = 0; tot < n; tot += m, off += m, src += m) {
-        reloc_clus(entry, off, 1);
+        if (reloc_clus(entry, off, 1) < 0) {
+            break;                  // volume full
+        }
         m = fat.byts_per_clus - off % fat.byts_per_clus;
         if (n - tot < m) {
             m = n - tot;
@@ -436,24 +1104,465 @@ int ewrite(struct dirent *entry, int user_src, uint64 src, uint off, uint n)
     return tot;
 }
 
+/**
+ * Directory iterator: keeps the sector of the last entry it handed
+ * out, so walking a directory reads each sector once, not once per
+ * 32-byte entry. Only that one buffer is held, and it is released
+ * before reloc_clus() reads the FAT. Changes to the entries are
+ * written when the iterator moves on, or in diter_put().
+ * Caller must hold dp->lock.
+ */
+struct diter {
+    struct dirent *dp;
+    struct buf *b;
+    uint32 soff;            // offset in the directory of the sector b holds
+    int dirty;
+};
+
+static struct {
+    uint64 scan;            // iterators started
+    uint64 sread;           // sectors they read
+} dstat;
+
+static void diter_init(struct diter *it, struct dirent *dp)
+{
+    it->dp = dp;
+    it->b = NULL;
+    it->dirty = 0;
+    __sync_fetch_and_add(&dstat.scan, 1);
+}
+
+static void diter_put(struct diter *it)
+{
+    if (it->b) {
+        if (it->dirty) {
+            bwrite(it->b);
+        }
+        brelse(it->b);
+        it->b = NULL;
+    }
+    it->dirty = 0;
+}
+
+// The entry at off of the directory, or NULL past its end
+// (unless alloc is set, which adds clusters up to off).
+static union dentry *diter_get(struct diter *it, uint off, int alloc)
+{
+    uint32 soff = off - off % BSIZE;
+    if (it->b == NULL || it->soff != soff) {
+        int off2;
+        diter_put(it);
+        if ((off2 = reloc_clus(it->dp, off, alloc)) == -1) {
+            return NULL;
+        }
+        it->b = bread(0, first_sec_of_clus(it->dp->cur_clus) + off2 / fat.bpb.byts_per_sec);
+        it->soff = soff;
+        __sync_fetch_and_add(&dstat.sread, 1);
+    }
+    return (union dentry *)(it->b->data + off % BSIZE);
+}
+
+// Write the entry at off, adding clusters as needed.
+static void diter_set(struct diter *it, uint off, union dentry *de)
+{
+    union dentry *p;
+    if ((p = diter_get(it, off, 1)) == NULL) {
+        panic("diter_set: no clusters");
+    }
+    memmove(p, de, sizeof(*de));
+    it->dirty = 1;
+}
+
+/**
+ * Directory iterator counters, for the iostat tool.
+ */
+void fat32_iostat(struct iostat *st)
+{
+    st->dirscan = dstat.scan;
+    st->dirsread = dstat.sread;
+}
+
+static int enext_it(struct diter *it, struct dirent *ep, uint off, int *count);
+
+/**
+ * Name index of a directory: where each file's entries start, hashed
+ * by name, plus the known runs of empty slots and the end of the used
+ * entries. It is built the first time dirlookup() misses the ecache,
+ * so the later lookups and creates in the directory don't walk it
+ * from the start. emake() and eremove() keep it in step. Collisions
+ * are told apart by reading the entry, so the index holds no names.
+ * If memory runs out, the index is dropped and dirlookup() walks the
+ * directory as before.
+ */
+#define NDHOLE      32
+
+struct dient {
+    struct dient *next;
+    uint32 hash;
+    uint32 off;
+};
+
+struct dipage {
+    struct dipage *next;
+    struct dient ents[(PGSIZE - sizeof(void *)) / sizeof(struct dient)];
+};
+
+struct dindex {
+    struct dipage *pages;
+    struct dient *free;
+    uint32 end;                         // offset after the last file
+    uint32 nhole;
+    struct {
+        uint32 off;
+        uint32 cnt;                     // in 32-byte slots
+    } hole[NDHOLE];
+    struct dient *bucket[];             // NDBUCKET of them, to the end of the page
+};
+
+#define NDBUCKET    ((PGSIZE - sizeof(struct dindex)) / sizeof(struct dient *))
+
+static uint32 dname_hash(char *name)
+{
+    uint32 h = 0;
+    for (int i = 0; i < FAT32_MAX_FILENAME && name[i]; i++) {
+        h = h * 31 + (uchar)name[i];
+    }
+    return h;
+}
+
+// Drop the name index of dp. Returns the number of pages freed.
+static int dindex_free(struct dirent *dp)
+{
+    struct dindex *dx = dp->dix;
+    struct dipage *pg;
+    int n = 0;
+
+    if (dx == NULL) {
+        return 0;
+    }
+    while ((pg = dx->pages) != NULL) {
+        dx->pages = pg->next;
+        kfree(pg);
+        n++;
+    }
+    kfree(dx);
+    dp->dix = NULL;
+    return n + 1;
+}
+
+// Record cnt empty slots at off, which were used or unknown so far.
+static void dindex_hole(struct dindex *dx, uint32 off, uint32 cnt)
+{
+    if (off + (cnt << 5) == dx->end) {
+        dx->end = off;
+    } else if (dx->nhole < NDHOLE) {
+        dx->hole[dx->nhole].off = off;
+        dx->hole[dx->nhole].cnt = cnt;
+        dx->nhole++;
+    }
+}
+
+// Where a file taking cnt slots should go, as dirlookup() reports in *poff.
+static uint32 dindex_slot(struct dindex *dx, uint32 cnt)
+{
+    for (int i = 0; i < dx->nhole; i++) {
+        if (dx->hole[i].cnt >= cnt) {
+            return dx->hole[i].off;
+        }
+    }
+    return dx->end;
+}
+
+// Index the file name taking cnt slots at off. Drops the index if out of memory.
+static int dindex_add(struct dirent *dp, char *name, uint32 off, uint32 cnt)
+{
+    struct dindex *dx = dp->dix;
+    struct dient *d;
+
+    if (dx->free == NULL) {
+        struct dipage *pg;
+        if ((pg = kalloc()) == NULL) {
+            dindex_free(dp);
+            return -1;
+        }
+        pg->next = dx->pages;
+        dx->pages = pg;
+        for (int i = 0; i < NELEM(pg->ents); i++) {
+            pg->ents[i].next = dx->free;
+            dx->free = &pg->ents[i];
+        }
+    }
+    d = dx->free;
+    dx->free = d->next;
+    d->hash = dname_hash(name);
+    d->off = off;
+    d->next = dx->bucket[d->hash % NDBUCKET];
+    dx->bucket[d->hash % NDBUCKET] = d;
+
+    // the slots may come out of a hole
+    for (int i = 0; i < dx->nhole; i++) {
+        uint32 hend = dx->hole[i].off + (dx->hole[i].cnt << 5);
+        if (off >= dx->hole[i].off && off < hend) {
+            if (off + (cnt << 5) >= hend) {
+                dx->hole[i] = dx->hole[--dx->nhole];
+            } else {
+                dx->hole[i].cnt = (hend - off - (cnt << 5)) >> 5;
+                dx->hole[i].off = off + (cnt << 5);
+            }
+            break;
+        }
+    }
+    if (off + (cnt << 5) > dx->end) {
+        dx->end = off + (cnt << 5);
+    }
+    return 0;
+}
+
+static int dindex_unlink(struct dindex *dx, uint32 b, uint32 off)
+{
+    for (struct dient **pp = &dx->bucket[b]; *pp != NULL; pp = &(*pp)->next) {
+        if ((*pp)->off == off) {
+            struct dient *d = *pp;
+            *pp = d->next;
+            d->next = dx->free;
+            dx->free = d;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Forget the file at off, most likely filed under name
+// (rename() changes the name before it removes the old entries).
+static void dindex_remove(struct dirent *dp, char *name, uint32 off)
+{
+    struct dindex *dx = dp->dix;
+
+    if (dindex_unlink(dx, dname_hash(name) % NDBUCKET, off)) {
+        return;
+    }
+    for (uint32 b = 0; b < NDBUCKET; b++) {
+        if (dindex_unlink(dx, b, off)) {
+            return;
+        }
+    }
+}
+
+// Walk dp once to build its index, using ep to hold each entry read.
+static struct dindex *dindex_build(struct dirent *dp, struct dirent *ep)
+{
+    struct dindex *dx;
+    struct diter it;
+    int count = 0, type;
+    uint off = 0;
+
+    if ((dx = kalloc_zeroed()) == NULL) {
+        return NULL;
+    }
+    dp->dix = dx;
+    diter_init(&it, dp);
+    while ((type = enext_it(&it, ep, off, &count)) != -1) {
+        if (type == 0) {
+            dindex_hole(dx, off, count);
+        } else if (dindex_add(dp, ep->filename, off, count) < 0) {
+            diter_put(&it);
+            return NULL;
+        }
+        off += count << 5;
+    }
+    diter_put(&it);
+    dx->end = off;
+    return dx;
+}
+
+// Find the slot of name in dp, or -1. Caller must hold ncache.lock.
+static int ncache_find(struct dirent *dp, char *name, uint32 h)
+{
+    for (int i = 0; i < NNCACHE; i++) {
+        if (ncache.ent[i].dclus == dp->first_clus && ncache.ent[i].hash == h
+            && ncache.ent[i].dev == dp->dev
+            && strncmp(ncache.ent[i].name, name, NC_NAMELEN + 1) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Is name known to be missing from dp?
+static int ncache_lookup(struct dirent *dp, char *name)
+{
+    int found;
+
+    if (strlen(name) > NC_NAMELEN) {
+        return 0;
+    }
+    acquire(&ncache.lock);
+    found = ncache_find(dp, name, dname_hash(name)) >= 0;
+    release(&ncache.lock);
+    return found;
+}
+
+static void ncache_add(struct dirent *dp, char *name)
+{
+    uint32 h = dname_hash(name);
+
+    if (strlen(name) > NC_NAMELEN) {
+        return;
+    }
+    acquire(&ncache.lock);
+    if (ncache_find(dp, name, h) < 0) {
+        int i = ncache.hand;
+        ncache.hand = (i + 1) % NNCACHE;
+        ncache.ent[i].dev = dp->dev;
+        ncache.ent[i].dclus = dp->first_clus;
+        ncache.ent[i].hash = h;
+        safestrcpy(ncache.ent[i].name, name, sizeof(ncache.ent[i].name));
+    }
+    release(&ncache.lock);
+}
+
+// Forget name in dp, or everything about dp if name is NULL.
+static void ncache_forget(struct dirent *dp, char *name)
+{
+    uint32 h = name ? dname_hash(name) : 0;
+
+    acquire(&ncache.lock);
+    for (int i = 0; i < NNCACHE; i++) {
+        if (ncache.ent[i].dclus == dp->first_clus && ncache.ent[i].dev == dp->dev
+            && (name == NULL || (ncache.ent[i].hash == h
+                && strncmp(ncache.ent[i].name, name, NC_NAMELEN + 1) == 0))) {
+            ncache.ent[i].dclus = 0;
+        }
+    }
+    release(&ncache.lock);
+}
+
+static uint ehash(struct dirent *parent, char *name)
+{
+    uint h = (uint)((uint64)parent >> 4);
+    for (int i = 0; i < FAT32_MAX_FILENAME && name[i]; i++) {
+        h = h * 31 + (uchar)name[i];
+    }
+    return h % NEHASH;
+}
+
+// Caller must hold ecache.lock.
+static void ehash_remove(struct dirent *ep)
+{
+    if (ep->hidx < 0) {
+        return;
+    }
+    for (struct dirent **pp = &ecache.hash[ep->hidx]; *pp != 0; pp = &(*pp)->hnext) {
+        if (*pp == ep) {
+            *pp = ep->hnext;
+            break;
+        }
+    }
+    ep->hnext = 0;
+    ep->hidx = -1;
+}
+
+// File ep under its parent and name. Caller must hold ecache.lock.
+static void ehash_insert(struct dirent *ep)
+{
+    ehash_remove(ep);
+    ep->parent_eid = ep->parent->eid;
+    ep->hidx = ehash(ep->parent, ep->filename);
+    ep->hnext = ecache.hash[ep->hidx];
+    ecache.hash[ep->hidx] = ep;
+}
+
+// Re-file ep in the ecache once it became valid,
+// or after its name or parent changed.
+void erehash(struct dirent *ep)
+{
+    acquire(&ecache.lock);
+    ehash_insert(ep);
+    release(&ecache.lock);
+}
+
+/**
+ * Make sure clusters are allocated for the bytes [off, off + len) of
+ * the file, taking them in as few runs as the free space allows. The
+ * file size grows to off + len unless keep is set, in which case the
+ * clusters only sit past the end until a write reaches them.
+ * Data clusters aren't zeroed when they are taken, so the bytes the
+ * size grows over are zeroed here, as nothing has written them.
+ * Caller must hold entry->lock.
+ * @return  0, or -1 if the volume fills up (what was added stays)
+ */
+int efalloc(struct dirent *entry, uint off, uint len, int keep)
+{
+    uint64 end = (uint64)off + len;
+    if (len == 0 || end > 0xffffffff
+        || (entry->attribute & (ATTR_READ_ONLY | ATTR_DIRECTORY))) {
+        return -1;
+    }
+    uint32 need = (end + fat.byts_per_clus - 1) / fat.byts_per_clus;
+    uint32 have = 0, last = 0;
+    epend_flush(entry);
+    if (entry->first_clus != 0) {
+        // find the last cluster, from wherever the cursor is
+        uint32 next;
+        if (entry->cur_clus < 2 || entry->cur_clus >= FAT32_EOC) {
+            entry->cur_clus = entry->first_clus;
+            entry->clus_cnt = 0;
+        }
+        while ((next = read_fat(entry->cur_clus)) >= 2 && next < FAT32_EOC) {
+            entry->cur_clus = next;
+            entry->clus_cnt++;
+        }
+        last = entry->cur_clus;
+        have = entry->clus_cnt + 1;
+    }
+    int ret = 0;
+    while (have < need) {
+        uint32 c, n;
+        if ((c = erun_take(entry, need - have, &n)) == 0) {
+            ret = -1;
+            break;
+        }
+        erun_link(entry, last, c, n);
+        last = c + n - 1;
+        have += n;
+        entry->cur_clus = last;
+        entry->clus_cnt = have - 1;
+    }
+    if (!keep && ret == 0 && end > entry->file_size) {
+        for (uint m, o = entry->file_size; o < end; o += m) {
+            reloc_clus(entry, o, 0);
+            m = fat.byts_per_clus - o % fat.byts_per_clus;
+            if (end - o < m)
+                m = end - o;
+            zero_clus_part(entry->cur_clus, o % fat.byts_per_clus, m);
+        }
+        entry->file_size = end;
+        entry->dirty = 1;
+    }
+    return ret;
+}
+
 // Returns a dirent struct. If name is given, check ecache. It is difficult to cache entries
 // by their whole path. But when parsing a path, we open all the directories through it, 
 // which forms a linked list from the final file to the root. Thus, we use the "parent" pointer 
 // to recognize whether an entry with the "name" as given is really the file we want in the right path.
 // Should never get root by eget, it's easy to understand.
+// Returns NULL if all entries are in use and there is no memory for more.
 
 // 返回一个dirent结构
 static struct dirent *eget(struct dirent *parent, char *name)
 {
     struct dirent *ep;
+    struct epage *pg;
+again:
     acquire(&ecache.lock);
     // 如果有name参数，检查ecache
     if (name) {
-        // 双向循环链表，检查回来退出循环，从前往后找最常用的
-        for (ep = root.next; ep != &root; ep = ep->next) {          // LRU 算法
+        for (ep = ecache.hash[ehash(parent, name)]; ep != 0; ep = ep->hnext) {
             // 如果有效，且他的父节点相等，且文件名相等
             // 则该文件结构引用+1，父亲引用如果没分配也+1
-            if (ep->valid == 1 && ep->parent == parent
+            // 父节点的槽位可能已被重新使用，所以还要比较parent_eid
+            if (ep->valid == 1 && ep->parent == parent && ep->parent_eid == parent->eid
                 && strncmp(ep->filename, name, FAT32_MAX_FILENAME) == 0) {
                 if (ep->ref++ == 0) {
                     ep->parent->ref++;
@@ -469,6 +1578,12 @@ static struct dirent *eget(struct dirent *parent, char *name)
     for (ep = root.prev; ep != &root; ep = ep->prev) {              // LRU 算法
         if (ep->ref == 0) {
             ep->ref = 1;
+            ehash_remove(ep);
+            eext_free(ep);
+            dindex_free(ep);
+            ep->res_cnt = 0;
+            ep->pend_cnt = 0;
+            ep->eid = ecache.nexteid++;
             ep->dev = parent->dev;
             ep->off = 0;
             ep->valid = 0;
@@ -477,8 +1592,68 @@ static struct dirent *eget(struct dirent *parent, char *name)
             return ep;
         }
     }
-    panic("eget: insufficient ecache");
-    return 0;
+    release(&ecache.lock);
+
+    // Every entry is in use: add a page of them and look again,
+    // since someone may have brought name in meanwhile.
+    if ((pg = kalloc()) == NULL) {
+        return NULL;
+    }
+    acquire(&ecache.lock);
+    pg->next = ecache.pages;
+    ecache.pages = pg;
+    for (int i = 0; i < EPAGE_NENT; i++) {
+        einit(&pg->entries[i]);
+    }
+    release(&ecache.lock);
+    goto again;
+}
+
+/**
+ * Give back the pages of extra entries that no one uses, and the name
+ * indexes and extent maps of entries no one uses, when kalloc() runs
+ * out of memory.
+ * Returns the number of pages freed.
+ */
+int ecache_shrink(void)
+{
+    struct epage **pp, *pg;
+    struct dirent *ep;
+    int n = 0, busy;
+
+    acquire(&ecache.lock);
+    for (ep = root.next; ep != &root; ep = ep->next) {
+        if (ep->ref == 0) {
+            n += dindex_free(ep);
+            n += eext_free(ep);
+        }
+    }
+    for (pp = &ecache.pages; (pg = *pp) != NULL; ) {
+        busy = 0;
+        for (int i = 0; i < EPAGE_NENT; i++) {
+            if (pg->entries[i].ref != 0) {
+                busy = 1;
+                break;
+            }
+        }
+        if (busy) {
+            pp = &pg->next;
+            continue;
+        }
+        for (int i = 0; i < EPAGE_NENT; i++) {
+            struct dirent *de = &pg->entries[i];
+            ehash_remove(de);
+            eext_free(de);
+            dindex_free(de);
+            de->next->prev = de->prev;
+            de->prev->next = de->next;
+        }
+        *pp = pg->next;
+        kfree(pg);
+        n++;
+    }
+    release(&ecache.lock);
+    return n;
 }
 
 // trim ' ' in the head and tail, '.' in head, and test legality
@@ -573,7 +1748,9 @@ void emake(struct dirent *dp, struct dirent *ep, uint off)
         panic("emake: not aligned");
     
     union dentry de;
+    struct diter it;
     memset(&de, 0, sizeof(de));
+    diter_init(&it, dp);
     if (off <= 32) {
         if (off == 0) {
             strncpy(de.sne.name, ".          ", sizeof(de.sne.name));
@@ -584,9 +1761,9 @@ void emake(struct dirent *dp, struct dirent *ep, uint off)
         de.sne.fst_clus_hi = (uint16)(ep->first_clus >> 16);        // first clus high 16 bits
         de.sne.fst_clus_lo = (uint16)(ep->first_clus & 0xffff);       // low 16 bits
         de.sne.file_size = 0;                                       // filesize is updated in eupdate()
-        off = reloc_clus(dp, off, 1);
-        rw_clus(dp->cur_clus, 1, 0, (uint64)&de, off, sizeof(de));
+        diter_set(&it, off, &de);
     } else {
+        ncache_forget(dp, ep->filename);
         int entcnt = (strlen(ep->filename) + CHAR_LONG_NAME - 1) / CHAR_LONG_NAME;   // count of l-n-entries, rounds up
         char shortname[CHAR_SHORT_NAME + 1];
         memset(shortname, 0, sizeof(shortname));
@@ -615,8 +1792,7 @@ void emake(struct dirent *dp, struct dirent *ep, uint off)
                     case 11:    w = (uint8 *)de.lne.name3; break;
                 }
             }
-            uint off2 = reloc_clus(dp, off, 1);
-            rw_clus(dp->cur_clus, 1, 0, (uint64)&de, off2, sizeof(de));
+            diter_set(&it, off, &de);
             off += sizeof(de);
         }
         memset(&de, 0, sizeof(de));
@@ -625,9 +1801,12 @@ void emake(struct dirent *dp, struct dirent *ep, uint off)
         de.sne.fst_clus_hi = (uint16)(ep->first_clus >> 16);      // first clus high 16 bits
         de.sne.fst_clus_lo = (uint16)(ep->first_clus & 0xffff);     // low 16 bits
         de.sne.file_size = ep->file_size;                         // filesize is updated in eupdate()
-        off = reloc_clus(dp, off, 1);
-        rw_clus(dp->cur_clus, 1, 0, (uint64)&de, off, sizeof(de));
+        diter_set(&it, off, &de);
+        if (dp->dix) {
+            dindex_add(dp, ep->filename, off - (entcnt << 5), entcnt + 1);
+        }
     }
+    diter_put(&it);
 }
 
 /**
@@ -647,7 +1826,9 @@ struct dirent *ealloc(struct dirent *dp, char *name, int attr)
         return ep;
     }
     //如果不存在,获取一个dirent
-    ep = eget(dp, name);
+    if ((ep = eget(dp, name)) == NULL) {
+        return NULL;
+    }
     elock(ep);
     ep->attribute = attr;
     ep->file_size = 0;
@@ -662,7 +1843,15 @@ struct dirent *ealloc(struct dirent *dp, char *name, int attr)
     ep->filename[FAT32_MAX_FILENAME] = '\0';
     if (attr == ATTR_DIRECTORY) {    // generate "." and ".." for ep
         ep->attribute |= ATTR_DIRECTORY;
-        ep->cur_clus = ep->first_clus = alloc_clus(dp->dev);
+        uint32 clus;
+        if ((clus = egrow(ep, 1)) == 0) {   // volume full
+            // ep is not valid yet, so eput() only drops the reference
+            eunlock(ep);
+            eput(ep->parent);
+            eput(ep);
+            return NULL;
+        }
+        ep->cur_clus = clus;
         emake(ep, ep, 0);
         emake(ep, dp, 32);
     } else {
@@ -670,6 +1859,7 @@ struct dirent *ealloc(struct dirent *dp, char *name, int attr)
     }
     emake(dp, ep, off);
     ep->valid = 1;
+    erehash(ep);
     eunlock(ep);
     return ep;
 }
@@ -691,17 +1881,20 @@ struct dirent *edup(struct dirent *entry)
 void eupdate(struct dirent *entry)
 {
     if (!entry->dirty || entry->valid != 1) { return; }
-    uint entcnt = 0;
-    uint32 off = reloc_clus(entry->parent, entry->off, 0);
-    rw_clus(entry->parent->cur_clus, 0, 0, (uint64) &entcnt, off, 1);
-    entcnt &= ~LAST_LONG_ENTRY;
-    off = reloc_clus(entry->parent, entry->off + (entcnt << 5), 0);
-    union dentry de;
-    rw_clus(entry->parent->cur_clus, 0, 0, (uint64)&de, off, sizeof(de));
-    de.sne.fst_clus_hi = (uint16)(entry->first_clus >> 16);
-    de.sne.fst_clus_lo = (uint16)(entry->first_clus & 0xffff);
-    de.sne.file_size = entry->file_size;
-    rw_clus(entry->parent->cur_clus, 1, 0, (uint64)&de, off, sizeof(de));
+    epend_flush(entry);         // the FAT gets the new clusters along with the new size
+    struct diter it;
+    union dentry *de;
+    diter_init(&it, entry->parent);
+    if ((de = diter_get(&it, entry->off, 0)) != NULL) {
+        uint entcnt = de->lne.order & ~LAST_LONG_ENTRY;
+        if ((de = diter_get(&it, entry->off + (entcnt << 5), 0)) != NULL) {
+            de->sne.fst_clus_hi = (uint16)(entry->first_clus >> 16);
+            de->sne.fst_clus_lo = (uint16)(entry->first_clus & 0xffff);
+            de->sne.file_size = entry->file_size;
+            it.dirty = 1;
+        }
+    }
+    diter_put(&it);
     entry->dirty = 0;
 }
 
@@ -714,28 +1907,87 @@ void eremove(struct dirent *entry)
     if (entry->valid != 1) { return; }
     uint entcnt = 0;
     uint32 off = entry->off;
-    uint32 off2 = reloc_clus(entry->parent, off, 0);
-    rw_clus(entry->parent->cur_clus, 0, 0, (uint64) &entcnt, off2, 1);
-    entcnt &= ~LAST_LONG_ENTRY;
-    uint8 flag = EMPTY_ENTRY;
-    for (int i = 0; i <= entcnt; i++) {
-        rw_clus(entry->parent->cur_clus, 1, 0, (uint64) &flag, off2, 1);
+    struct diter it;
+    union dentry *de;
+    diter_init(&it, entry->parent);
+    if ((de = diter_get(&it, off, 0)) != NULL) {
+        entcnt = de->lne.order & ~LAST_LONG_ENTRY;
+    }
+    for (int i = 0; i <= entcnt && (de = diter_get(&it, off, 0)) != NULL; i++) {
+        de->lne.order = EMPTY_ENTRY;
+        it.dirty = 1;
         off += 32;
-        off2 = reloc_clus(entry->parent, off, 0);
+    }
+    diter_put(&it);
+    if (entry->parent->dix) {
+        dindex_remove(entry->parent, entry->filename, entry->off);
+        dindex_hole(entry->parent->dix, entry->off, entcnt + 1);
     }
     entry->valid = -1;
 }
 
+/**
+ * Write the free cluster count and next free cluster hint
+ * back to the FSInfo sector. Called by sync() and fsync().
+ */
+void fat32_sync(void)
+{
+    acquiresleep(&clusmap.lock);
+    fsinfo_sync();
+    releasesleep(&clusmap.lock);
+}
+
+/**
+ * Report the size and free space of the volume. The free count
+ * normally comes from FSInfo; without it, the FAT is read once
+ * to count, and the count is kept up to date from then on.
+ */
+void fat32_statfs(struct statfs *st)
+{
+    acquiresleep(&clusmap.lock);
+    if (clusmap.free == FSI_UNKNOWN) {
+        uint32 free = 0;
+        for (uint32 p = 0; p < clusmap.npage; p++) {
+            if (clusmap.map[p] == 0)
+                clusmap_load(p);
+            free += clusmap.nfree[p];
+        }
+        clusmap.free = free;
+        fsinfo.nchange++;
+        fsinfo_sync();
+    }
+    memset(st, 0, sizeof(*st));
+    st->f_type = MSDOS_SUPER_MAGIC;
+    st->f_bsize = fat.byts_per_clus;
+    st->f_blocks = fat.data_clus_cnt;
+    st->f_bfree = clusmap.free;
+    st->f_bavail = clusmap.free;
+    st->f_namelen = FAT32_MAX_FILENAME;
+    st->f_frsize = fat.byts_per_clus;
+    releasesleep(&clusmap.lock);
+}
+
 // truncate a file
 // caller must hold entry->lock
 // 截断文件
 void etrunc(struct dirent *entry)
 {
-    for (uint32 clus = entry->first_clus; clus >= 2 && clus < FAT32_EOC; ) {
-        uint32 next = read_fat(clus);
-        free_clus(clus);
-        clus = next;
+    eres_release(entry);
+    eext_free(entry);
+    dindex_free(entry);
+    if (entry->attribute & ATTR_DIRECTORY) {
+        ncache_forget(entry, NULL);     // its clusters may hold another directory later
     }
+    entry->clus_gen++;          // saved cursors point into the freed chain
+    uint32 first = entry->first_clus;
+    if (entry->pend_cnt != 0) {
+        // pending clusters aren't in the FAT, only in the bitmap
+        clusmap_release(entry->pend_clus, entry->pend_cnt);
+        if (entry->pend_prev == 0)
+            first = 0;
+        entry->pend_cnt = 0;
+    }
+    free_chain(first);
     entry->file_size = 0;
     entry->first_clus = 0;
     entry->dirty = 1;
@@ -775,6 +2027,7 @@ void eput(struct dirent *entry)
         if (entry->valid == -1) {       // this means some one has called eremove()
             etrunc(entry);
         } else {
+            eres_release(entry);
             elock(entry->parent);
             eupdate(entry);
             eunlock(entry->parent);
@@ -866,6 +2119,18 @@ static void read_entry_info(struct dirent *entry, union dentry *d)
  */
 int enext(struct dirent *dp, struct dirent *ep, uint off, int *count)
 {
+    struct diter it;
+    diter_init(&it, dp);
+    int ret = enext_it(&it, ep, off, count);
+    diter_put(&it);
+    return ret;
+}
+
+// enext() through an iterator, which may still hold the sector
+// of the entries before off. Directory walks use this.
+static int enext_it(struct diter *it, struct dirent *ep, uint off, int *count)
+{
+    struct dirent *dp = it->dp;
     if (!(dp->attribute & ATTR_DIRECTORY))
         panic("enext not dir");
     if (ep->valid)
@@ -874,39 +2139,81 @@ int enext(struct dirent *dp, struct dirent *ep, uint off, int *count)
         panic("enext not align");
     if (dp->valid != 1) { return -1; }
 
-    union dentry de;
+    union dentry *de;
     int cnt = 0;
     memset(ep->filename, 0, FAT32_MAX_FILENAME + 1);
-    for (int off2; (off2 = reloc_clus(dp, off, 0)) != -1; off += 32) {
-        if (rw_clus(dp->cur_clus, 0, 0, (uint64)&de, off2, 32) != 32 || de.lne.order == END_OF_ENTRY) {
+    for (; (de = diter_get(it, off, 0)) != NULL; off += 32) {
+        if (de->lne.order == END_OF_ENTRY) {
             return -1;
         }
-        if (de.lne.order == EMPTY_ENTRY) {
+        if (de->lne.order == EMPTY_ENTRY) {
             cnt++;
             continue;
         } else if (cnt) {
             *count = cnt;
             return 0;
         }
-        if (de.lne.attr == ATTR_LONG_NAME) {
-            int lcnt = de.lne.order & ~LAST_LONG_ENTRY;
-            if (de.lne.order & LAST_LONG_ENTRY) {
+        if (de->lne.attr == ATTR_LONG_NAME) {
+            int lcnt = de->lne.order & ~LAST_LONG_ENTRY;
+            if (de->lne.order & LAST_LONG_ENTRY) {
                 *count = lcnt + 1;                              // plus the s-n-e;
                 count = 0;
             }
-            read_entry_name(ep->filename + (lcnt - 1) * CHAR_LONG_NAME, &de);
+            read_entry_name(ep->filename + (lcnt - 1) * CHAR_LONG_NAME, de);
         } else {
             if (count) {
                 *count = 1;
-                read_entry_name(ep->filename, &de);
+                read_entry_name(ep->filename, de);
             }
-            read_entry_info(ep, &de);
+            read_entry_info(ep, de);
             return 1;
         }
     }
     return -1;
 }
 
+/**
+ * Fill buf with linux_dirent64 records for the files of dp from *poff on,
+ * as many as fit in n bytes, and move *poff past them. The directory is
+ * read a sector at a time. Caller must hold dp->lock.
+ * @return  bytes filled, 0 at the end of the directory,
+ *          -1 if not even the next record fits
+ */
+int edents(struct dirent *dp, uint *poff, char *buf, int n)
+{
+    struct dirent de;
+    struct diter it;
+    struct linux_dirent64 *d;
+    int count = 0, type, tot = 0;
+    uint off = *poff;
+
+    de.valid = 0;
+    diter_init(&it, dp);
+    while ((type = enext_it(&it, &de, off, &count)) != -1) {
+        if (type == 1) {
+            int len = strlen(de.filename);
+            int reclen = DIRENT64_RECLEN(len);
+            if (tot + reclen > n) {
+                if (tot == 0) {
+                    tot = -1;
+                }
+                break;
+            }
+            d = (struct linux_dirent64 *)(buf + tot);
+            d->d_ino = de.first_clus;
+            d->d_off = off + (count << 5);
+            d->d_reclen = reclen;
+            d->d_type = (de.attribute & ATTR_DIRECTORY) ? DT_DIR : DT_REG;
+            memmove(d->d_name, de.filename, len + 1);
+            tot += reclen;
+        }
+        off += count << 5;
+    }
+    diter_put(&it);
+    *poff = off;
+    return tot;
+}
+
 /**
  * Seacher for the entry in a directory and return a structure. Besides, record the offset of
  * some continuous empty slots that can fit the length of filename.
@@ -930,7 +2237,11 @@ struct dirent *dirlookup(struct dirent *dp, char *filename, uint *poff)
     if (dp->valid != 1) {
         return NULL;
     }
+    if (poff == NULL && ncache_lookup(dp, filename)) {
+        return NULL;
+    }
     struct dirent *ep = eget(dp, filename);
+    if (ep == NULL) { return NULL; }                                 // out of memory
     if (ep->valid == 1) { return ep; }                               // ecache hits
 
     int len = strlen(filename);
@@ -938,24 +2249,49 @@ struct dirent *dirlookup(struct dirent *dp, char *filename, uint *poff)
     int count = 0;
     int type;
     uint off = 0;
-    reloc_clus(dp, 0, 0);
-    while ((type = enext(dp, ep, off, &count) != -1)) {
+    struct dindex *dx;
+    if ((dx = dp->dix) != NULL || (dx = dindex_build(dp, ep)) != NULL) {
+        uint32 h = dname_hash(filename);
+        for (struct dient *d = dx->bucket[h % NDBUCKET]; d != NULL; d = d->next) {
+            if (d->hash == h && enext(dp, ep, d->off, &count) == 1
+                && strncmp(filename, ep->filename, FAT32_MAX_FILENAME) == 0) {
+                ep->parent = edup(dp);
+                ep->off = d->off;
+                ep->valid = 1;
+                erehash(ep);
+                return ep;
+            }
+        }
+        if (poff) {
+            *poff = dindex_slot(dx, entcnt);
+        }
+        ncache_add(dp, filename);
+        eput(ep);
+        return NULL;
+    }
+    struct diter it;
+    diter_init(&it, dp);
+    while ((type = enext_it(&it, ep, off, &count)) != -1) {
         if (type == 0) {
             if (poff && count >= entcnt) {
                 *poff = off;
                 poff = 0;
             }
         } else if (strncmp(filename, ep->filename, FAT32_MAX_FILENAME) == 0) {
+            diter_put(&it);
             ep->parent = edup(dp);
             ep->off = off;
             ep->valid = 1;
+            erehash(ep);
             return ep;
         }
         off += count << 5;
     }
+    diter_put(&it);
     if (poff) {
         *poff = off;
     }
+    ncache_add(dp, filename);
     eput(ep);
     return NULL;
 }
@@ -983,13 +2319,14 @@ static char *skipelem(char *path, char *name)
 }
 
 // FAT32 version of namex in xv6's original file system.
-static struct dirent *lookup_path(char *path, int parent, char *name)
+// Relative paths start at base, or at the cwd if base is NULL.
+static struct dirent *lookup_path(struct dirent *base, char *path, int parent, char *name)
 {
     struct dirent *entry, *next;
     if (*path == '/') {
         entry = edup(&root);
     } else if (*path != '\0') {
-        entry = edup(myproc()->cwd);
+        entry = edup(base ? base : myproc()->cwd);
     } else {
         return NULL;
     }
@@ -1023,10 +2360,21 @@ static struct dirent *lookup_path(char *path, int parent, char *name)
 struct dirent *ename(char *path)
 {
     char name[FAT32_MAX_FILENAME + 1];
-    return lookup_path(path, 0, name);
+    return lookup_path(NULL, path, 0, name);
 }
 
 struct dirent *enameparent(char *path, char *name)
 {
-    return lookup_path(path, 1, name);
+    return lookup_path(NULL, path, 1, name);
+}
+
+struct dirent *enameat(struct dirent *base, char *path)
+{
+    char name[FAT32_MAX_FILENAME + 1];
+    return lookup_path(base, path, 0, name);
+}
+
+struct dirent *enameparentat(struct dirent *base, char *path, char *name)
+{
+    return lookup_path(base, path, 1, name);
 }
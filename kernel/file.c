@@ -16,43 +16,41 @@
 #include "../libs/printf.h"
 #include "../libs/string.h"
 #include "../libs/vm.h"
+#include "../libs/buf.h"
+#include "../libs/fcntl.h"
+#include "../libs/kalloc.h"
+#include "../libs/slab.h"
 
 struct devsw devsw[NDEV];
+// Open files come from a slab cache, so there is no limit on them
+// but memory. The lock protects their reference counts.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct kmem_cache cache;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
-  struct file *f;
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    memset(f, 0, sizeof(struct file));
-  }
+  kmem_cache_init(&ftable.cache, "file", sizeof(struct file));
   #ifdef DEBUG
   printf("fileinit\n");
   #endif
 }
 
 // Allocate a file structure.
-// 扫描整个文件表来寻找一个没有被引用的文件（file->ref == 0)并且返回一个新的引用
+// 从slab缓存中分配一个文件结构，并且返回一个新的引用
 struct file*
 filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return NULL;
+  if((f = kmem_cache_alloc(&ftable.cache)) == NULL)
+    return NULL;
+  memset(f, 0, sizeof(struct file));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -94,6 +92,7 @@ fileclose(struct file *f)
   } else if (ff.type == FD_DEVICE) {
 
   }
+  kmem_cache_free(&ftable.cache, f);
 }
 
 // Get metadata about file f.
@@ -117,13 +116,57 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+#define RA_MIN    (4 * BSIZE)     // first read-ahead window
+#define RA_MAX    (16 * BSIZE)    // largest read-ahead window
+
+// Adapt f's read-ahead window after a read that ended at f->off,
+// and queue more read-ahead once half of the window is consumed.
+// Random access shuts the window, sequential access doubles it.
+// Caller must hold f->ep->lock.
+static void
+readahead(struct file *f, int seq)
+{
+  if(!seq){
+    f->ra_win = 0;
+    f->ra_end = f->off;
+    return;
+  }
+  if(f->ra_win == 0)
+    f->ra_win = RA_MIN;
+  else if(f->ra_win < RA_MAX)
+    f->ra_win *= 2;
+
+  if(f->ra_end < f->off)
+    f->ra_end = f->off;
+  if(f->ra_end - f->off <= f->ra_win / 2){
+    ereadahead(f->ep, f->ra_end, f->off + f->ra_win - f->ra_end);
+    f->ra_end = f->off + f->ra_win;
+  }
+}
+
+// Make f's position in the cluster chain the entry's current one,
+// and take it back afterwards. Caller must hold f->ep->lock.
+static void
+fcursor_in(struct file *f)
+{
+  ecursor_load(f->ep, f->cur_clus, f->clus_cnt, f->clus_gen);
+}
+
+static void
+fcursor_out(struct file *f)
+{
+  f->cur_clus = f->ep->cur_clus;
+  f->clus_cnt = f->ep->clus_cnt;
+  f->clus_gen = f->ep->clus_gen;
+}
+
 // Read from file f.
 // addr is a user virtual address.
 // 文件读取，addr是用户虚拟地址
 int
 fileread(struct file *f, uint64 addr, int n)
 {
-  int r = 0;
+  int r = 0, seq;
 
   if(f->readable == 0)
     return -1;
@@ -139,8 +182,13 @@ fileread(struct file *f, uint64 addr, int n)
         break;
     case FD_ENTRY:
         elock(f->ep);
+          fcursor_in(f);
+          seq = (f->off == f->ra_next);
           if((r = eread(f->ep, 1, addr, f->off, n)) > 0)
             f->off += r;
+          f->ra_next = f->off;
+          readahead(f, seq);
+          fcursor_out(f);
         eunlock(f->ep);
         break;
     default:
@@ -168,12 +216,14 @@ filewrite(struct file *f, uint64 addr, int n)
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_ENTRY){
     elock(f->ep);
+    fcursor_in(f);
     if (ewrite(f->ep, 1, addr, f->off, n) == n) {
       ret = n;
       f->off += n;
     } else {
       ret = -1;
     }
+    fcursor_out(f);
     eunlock(f->ep);
   } else {
     panic("filewrite");
@@ -182,6 +232,47 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// Move the offset of file f.
+// FAT32 files have no holes, so it can't go past the end.
+int
+fileseek(struct file *f, int off, int whence)
+{
+  int base;
+
+  if(f->type != FD_ENTRY)
+    return -1;
+  elock(f->ep);
+  switch (whence) {
+    case SEEK_SET: base = 0; break;
+    case SEEK_CUR: base = f->off; break;
+    case SEEK_END: base = f->ep->file_size; break;
+    default: base = -1;
+  }
+  if(base < 0 || base + off < 0 || base + off > f->ep->file_size){
+    eunlock(f->ep);
+    return -1;
+  }
+  f->off = base + off;
+  eunlock(f->ep);
+  return f->off;
+}
+
+// Allocate disk space for [off, off + len) of file f up front,
+// growing the file unless mode has FALLOC_FL_KEEP_SIZE.
+int
+filefalloc(struct file *f, int mode, int off, int len)
+{
+  int r;
+
+  if(f->type != FD_ENTRY || f->writable == 0 || off < 0 || len <= 0
+     || (mode & ~FALLOC_FL_KEEP_SIZE))
+    return -1;
+  elock(f->ep);
+  r = efalloc(f->ep, off, len, mode & FALLOC_FL_KEEP_SIZE);
+  eunlock(f->ep);
+  return r;
+}
+
 // Read from dir f.
 // addr is a user virtual address.
 int
@@ -197,9 +288,11 @@ dirnext(struct file *f, uint64 addr)
   int count = 0;
   int ret;
   elock(f->ep);
+  fcursor_in(f);
   while ((ret = enext(f->ep, &de, f->off, &count)) == 0) {  // skip empty entry
     f->off += count * 32;
   }
+  fcursor_out(f);
   eunlock(f->ep);
   if (ret == -1)
     return 0;
@@ -211,4 +304,39 @@ dirnext(struct file *f, uint64 addr)
     return -1;
 
   return 1;
+}
+
+// Read as many directory records as fit in n bytes at user
+// address addr, in getdents64() format, under one lock of the
+// directory. Returns the bytes read, 0 at the end.
+int
+filegetdents(struct file *f, uint64 addr, int n)
+{
+  char *buf;
+  int m, tot = 0;
+
+  if(f->type != FD_ENTRY || f->readable == 0 || !(f->ep->attribute & ATTR_DIRECTORY))
+    return -1;
+  if((buf = kalloc()) == NULL)
+    return -1;
+
+  elock(f->ep);
+  fcursor_in(f);
+  while(tot < n){
+    m = edents(f->ep, &f->off, buf, n - tot < PGSIZE ? n - tot : PGSIZE);
+    if(m <= 0){
+      if(tot == 0)
+        tot = m;
+      break;
+    }
+    if(copyout2(addr + tot, buf, m) < 0){
+      tot = -1;
+      break;
+    }
+    tot += m;
+  }
+  fcursor_out(f);
+  eunlock(f->ep);
+  kfree(buf);
+  return tot;
 }
\ No newline at end of file
@@ -1,6 +1,21 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// or blocks of 2^k contiguous pages with kalloc_pages().
+//
+// Free memory is kept by a buddy allocator: a free block of 2^k
+// pages starts at a physical address aligned to its size, and is on
+// kmem.free[k]. A freed block merges with its buddy, the other half
+// of the block twice its size, for as long as that one is free too.
+//
+// Each hart keeps a cache of free pages under its own lock, so
+// kalloc() and kfree() normally touch no lock another hart takes.
+// The cache is refilled from and drained to the buddy allocator
+// KCACHE_BATCH pages at a time.
+//
+// Idle harts also keep a pool of zeroed pages for kalloc_zeroed().
+// Pages are filled with junk on kalloc() and kfree() in debug
+// builds only.
 
 
 #include "../libs/types.h"
@@ -8,9 +23,15 @@
 #include "../libs/memlayout.h"
 #include "../libs/riscv.h"
 #include "../libs/spinlock.h"
+#include "../libs/intr.h"
+#include "../libs/proc.h"
 #include "../libs/kalloc.h"
+#include "../libs/sysinfo.h"
 #include "../libs/string.h"
 #include "../libs/printf.h"
+#include "../libs/fat32.h"
+#include "../libs/slab.h"
+#include "../libs/ktrace.h"
 
 void freerange(void *pa_start, void *pa_end);
 
@@ -18,20 +39,57 @@ extern char kernel_end[]; // first address after kernel.
 
 struct run {
   struct run *next;
+  struct run *prev;           // on kmem.free[] only
 };
 
+#define NORDER          SI_NORDER
+#define NKPAGE          ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PIDX(pa)        (((uint64)(pa) - KERNBASE) / PGSIZE)
+
 struct {
   struct spinlock lock;
-  struct run *freelist;
+  struct run free[NORDER];    // circular lists of free blocks by order
+  uint64 nblk[NORDER];        // blocks on each
   uint64 npage;
+  uint64 base;                // first page it manages
 } kmem;
 
+// k + 1 for the first page of a free block of 2^k pages, else 0
+static uint8 kfreeord[NKPAGE];
+
+// Mappings of a page besides the first, by copy-on-write fork.
+// kfree() only frees a page once this is 0.
+static uint32 kref[NKPAGE];
+
+#define KCACHE_MAX      64    // a hart's cache is drained when it gets this big
+#define KCACHE_BATCH    32    // pages moved to or from kmem at once
+
+static struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int npage;
+} kcache[NCPU];
+
+#define KZERO_MAX       64    // zeroed pages kept at most
+#define KZERO_BATCH     8     // pages an idle hart zeroes before looking for work
+
+static struct {
+  struct spinlock lock;
+  struct run *freelist;
+  int npage;
+} kzero;
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
-  kmem.freelist = 0;
+  for(int k = 0; k < NORDER; k++)
+    kmem.free[k].next = kmem.free[k].prev = &kmem.free[k];
   kmem.npage = 0;
+  kmem.base = PGROUNDUP((uint64)kernel_end);
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcache[i].lock, "kcache");
+  initlock(&kzero.lock, "kzero");
   freerange(kernel_end, (void*)PHYSTOP);
   #ifdef DEBUG
   printf("kernel_end: %p, phystop: %p\n", kernel_end, (void*)PHYSTOP);
@@ -39,13 +97,169 @@ kinit()
   #endif
 }
 
+// Caller must hold kmem.lock for these.
+static void
+blk_push(struct run *r, int k)
+{
+  struct run *h = &kmem.free[k];
+
+  r->next = h->next;
+  r->prev = h;
+  h->next->prev = r;
+  h->next = r;
+  kfreeord[PIDX(r)] = k + 1;
+  kmem.nblk[k]++;
+}
+
+static void
+blk_remove(struct run *r, int k)
+{
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+  kfreeord[PIDX(r)] = 0;
+  kmem.nblk[k]--;
+}
+
+// Take a block of 2^k pages, splitting a bigger one if need be.
+static struct run *
+buddy_alloc(int k)
+{
+  struct run *r;
+  int j;
+
+  for(j = k; j < NORDER && kmem.free[j].next == &kmem.free[j]; j++)
+    ;
+  if(j == NORDER)
+    return 0;
+  r = kmem.free[j].next;
+  blk_remove(r, j);
+  // give back the upper halves
+  while(j > k){
+    j--;
+    blk_push((struct run *)((uint64)r + ((uint64)PGSIZE << j)), j);
+  }
+  kmem.npage -= 1 << k;
+  return r;
+}
+
+// Free the block of 2^k pages at pa, merging it with free buddies.
+static void
+buddy_free(uint64 pa, int k)
+{
+  uint64 b, size;
+
+  kmem.npage += 1 << k;
+  for(; k < NORDER - 1; k++){
+    size = (uint64)PGSIZE << k;
+    b = pa ^ size;
+    if(b < kmem.base || b + size > PHYSTOP || kfreeord[PIDX(b)] != k + 1)
+      break;
+    blk_remove((struct run *)b, k);
+    if(b < pa)
+      pa = b;
+  }
+  blk_push((struct run *)pa, k);
+}
+
 void
 freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
+  acquire(&kmem.lock);
   for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+    buddy_free((uint64)p, 0);
+  release(&kmem.lock);
+}
+
+// Move KCACHE_BATCH pages from the cache of a hart to kmem.
+// Caller must hold c->lock.
+static void
+kdrain(struct kcache *c)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  for(int i = 0; i < KCACHE_BATCH; i++){
+    r = c->freelist;
+    c->freelist = r->next;
+    buddy_free((uint64)r, 0);
+  }
+  release(&kmem.lock);
+  c->npage -= KCACHE_BATCH;
+}
+
+// Move up to KCACHE_BATCH pages from kmem to the cache of a hart.
+// Caller must hold c->lock.
+static void
+krefill(struct kcache *c)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  while(c->npage < KCACHE_BATCH && (r = buddy_alloc(0)) != 0){
+    r->next = c->freelist;
+    c->freelist = r;
+    c->npage++;
+  }
+  release(&kmem.lock);
+}
+
+// Give all the pages in the hart caches and the zeroed pool back to
+// the buddy allocator, so that they can merge into bigger blocks.
+static void
+kreclaim(void)
+{
+  struct kcache *c;
+  struct run *r;
+
+  for(c = kcache; c < kcache + NCPU; c++){
+    acquire(&c->lock);
+    acquire(&kmem.lock);
+    while((r = c->freelist) != 0){
+      c->freelist = r->next;
+      buddy_free((uint64)r, 0);
+    }
+    c->npage = 0;
+    release(&kmem.lock);
+    release(&c->lock);
+  }
+  acquire(&kzero.lock);
+  acquire(&kmem.lock);
+  while((r = kzero.freelist) != 0){
+    kzero.freelist = r->next;
+    buddy_free((uint64)r, 0);
+  }
+  kzero.npage = 0;
+  release(&kmem.lock);
+  release(&kzero.lock);
+}
+
+// Note another mapping of page pa.
+void
+kref_get(void *pa)
+{
+  __sync_fetch_and_add(&kref[PIDX(pa)], 1);
+}
+
+// Whether page pa is mapped more than once.
+int
+kshared(void *pa)
+{
+  return kref[PIDX(pa)] != 0;
+}
+
+// Drop a mapping of pa if it has more than one, and return 1; else 0.
+static int
+kref_put(void *pa)
+{
+  uint32 *r = &kref[PIDX(pa)], v;
+
+  do {
+    if((v = *r) == 0)
+      return 0;
+  } while(!__sync_bool_compare_and_swap(r, v, v - 1));
+  return 1;
 }
 
 // Free the page of physical memory pointed at by v,
@@ -59,17 +273,87 @@ kfree(void *pa)
   
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < kernel_end || (uint64)pa >= PHYSTOP)
     panic("kfree");
+  if(kref_put(pa))
+    return;                 // still mapped by another process
 
+  ktrace(TR_KFREE, pa, 0);
+  #ifdef DEBUG
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+  #endif
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  kmem.npage++;
-  release(&kmem.lock);
+  push_off();
+  struct kcache *c = &kcache[cpuid()];
+  acquire(&c->lock);
+  r->next = c->freelist;
+  c->freelist = r;
+  if(++c->npage >= KCACHE_MAX)
+    kdrain(c);
+  release(&c->lock);
+  pop_off();
+}
+
+// Take a page from another hart's cache, once kmem is empty too.
+static struct run *
+ksteal(struct kcache *self)
+{
+  struct run *r = 0;
+
+  for(struct kcache *c = kcache; c < kcache + NCPU && r == 0; c++){
+    if(c == self)
+      continue;
+    acquire(&c->lock);
+    if((r = c->freelist) != 0){
+      c->freelist = r->next;
+      c->npage--;
+    }
+    release(&c->lock);
+  }
+  return r;
+}
+
+static struct run *
+ktake(void)
+{
+  struct kcache *c;
+  struct run *r;
+
+  push_off();
+  c = &kcache[cpuid()];
+  acquire(&c->lock);
+  if(c->npage == 0)
+    krefill(c);
+  if((r = c->freelist) != 0){
+    c->freelist = r->next;
+    c->npage--;
+  }
+  release(&c->lock);
+  // not holding c->lock, or two harts stealing from each other deadlock
+  if(r == 0)
+    r = ksteal(c);
+  pop_off();
+  return r;
+}
+
+// Take a page from the zeroed pool, or return 0.
+static struct run *
+kzero_take(void)
+{
+  struct run *r;
+
+  // npage read without the lock is only a hint, but it keeps the
+  // harts off kzero.lock while the pool is empty.
+  if(kzero.npage == 0)
+    return 0;
+  acquire(&kzero.lock);
+  if((r = kzero.freelist) != 0){
+    kzero.freelist = r->next;
+    kzero.npage--;
+  }
+  release(&kzero.lock);
+  return r;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -80,21 +364,144 @@ kalloc(void)
 {
   struct run *r;
 
+  // Out of pages: try the zeroed pool, then take back the spare
+  // directory entry cache pages and empty slabs. Must not be called
+  // with ecache.lock or a kmem_cache lock held.
+  if((r = ktake()) == 0 && (r = kzero_take()) == 0
+     && ecache_shrink() + kmem_cache_reap() > 0)
+    r = ktake();
+
+  if(r){
+    ktrace(TR_KALLOC, r, 0);
+    #ifdef DEBUG
+    memset((char*)r, 5, PGSIZE); // fill with junk
+    #endif
+  }
+  return (void*)r;
+}
+
+// Allocate a page of zeroes, from the pool if it has one.
+void *
+kalloc_zeroed(void)
+{
+  struct run *r;
+
+  if((r = kzero_take()) != 0){
+    ktrace(TR_KALLOC, r, 0);
+    return (void*)r;
+  }
+  if((r = kalloc()) != 0)
+    memset((char*)r, 0, PGSIZE);
+  return (void*)r;
+}
+
+// Allocate 2^order physically contiguous pages, aligned to their size.
+// Returns 0 if there is no free block that big.
+void *
+kalloc_pages(int order)
+{
+  struct run *r;
+
+  if(order == 0)
+    return kalloc();
+  if(order < 0 || order >= NORDER)
+    return 0;
   acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r) {
-    kmem.freelist = r->next;
-    kmem.npage--;
+  r = buddy_alloc(order);
+  release(&kmem.lock);
+  if(r == 0){
+    // the pages cached one by one may be what the block lacks
+    kreclaim();
+    acquire(&kmem.lock);
+    r = buddy_alloc(order);
+    release(&kmem.lock);
+  }
+  if(r){
+    ktrace(TR_KALLOC, r, order);
+    #ifdef DEBUG
+    memset((char*)r, 5, (uint64)PGSIZE << order);
+    #endif
   }
+  return (void*)r;
+}
+
+// Free a block from kalloc_pages(order).
+void
+kfree_pages(void *pa, int order)
+{
+  uint64 size = (uint64)PGSIZE << order;
+
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+  if(order < 0 || order >= NORDER || (uint64)pa % size != 0
+     || (uint64)pa < kmem.base || (uint64)pa + size > PHYSTOP)
+    panic("kfree_pages");
+  ktrace(TR_KFREE, pa, order);
+  #ifdef DEBUG
+  memset(pa, 1, size);
+  #endif
+  acquire(&kmem.lock);
+  buddy_free((uint64)pa, order);
   release(&kmem.lock);
+}
 
-  if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
-  return (void*)r;
+// Called by a hart with nothing to run: zero up to KZERO_BATCH free
+// pages for kalloc_zeroed(). Returns how many, 0 once the pool is full.
+int
+kzero_fill(void)
+{
+  struct run *r;
+  int n;
+
+  for(n = 0; n < KZERO_BATCH; n++){
+    acquire(&kzero.lock);
+    int full = kzero.npage >= KZERO_MAX;
+    release(&kzero.lock);
+    if(full || (r = ktake()) == 0)
+      break;
+    memset((char*)r, 0, PGSIZE);
+    acquire(&kzero.lock);
+    r->next = kzero.freelist;
+    kzero.freelist = r;
+    kzero.npage++;
+    release(&kzero.lock);
+  }
+  return n;
 }
 
 uint64
 freemem_amount(void)
 {
-  return kmem.npage << PGSHIFT;
+  uint64 n;
+  int i;
+
+  // all of the locks, in the order kfree() takes them, so that
+  // no batch is counted twice or missed on its way; only a page
+  // kzero_fill() is zeroing at the moment isn't counted
+  for(i = 0; i < NCPU; i++)
+    acquire(&kcache[i].lock);
+  acquire(&kmem.lock);
+  n = kmem.npage;
+  release(&kmem.lock);
+  acquire(&kzero.lock);
+  n += kzero.npage;
+  release(&kzero.lock);
+  for(i = NCPU - 1; i >= 0; i--){
+    n += kcache[i].npage;
+    release(&kcache[i].lock);
+  }
+  return n << PGSHIFT;
+}
+
+// Free blocks of each order in the buddy allocator; pages in the hart
+// caches and the zeroed pool aren't in there.
+void
+kalloc_stat(uint64 *nblk)
+{
+  acquire(&kmem.lock);
+  for(int k = 0; k < NORDER; k++)
+    nblk[k] = kmem.nblk[k];
+  release(&kmem.lock);
 }
@@ -0,0 +1,125 @@
+// Kernel event trace.
+//
+// Tracepoints (ktrace() in ktrace.h) append fixed-size records to a
+// ring per hart. Only that hart writes its ring, with interrupts off,
+// so writers take no lock: the record is filled in before head moves
+// past it, and a full ring drops the record. ktrace(KTRACE_READ) takes
+// records from the tail; readers are serialized among themselves only.
+// user/trace.c turns on the events asked for around a command and
+// prints what they recorded.
+
+#include "../libs/types.h"
+#include "../libs/param.h"
+#include "../libs/riscv.h"
+#include "../libs/spinlock.h"
+#include "../libs/sleeplock.h"
+#include "../libs/intr.h"
+#include "../libs/proc.h"
+#include "../libs/vm.h"
+#include "../libs/ktrace.h"
+
+#define TR_NRING      512   // records per hart
+
+struct trring {
+  volatile uint head;       // records [tail, head) are waiting,
+  volatile uint tail;       // at index mod TR_NRING
+  uint64 drop;              // records lost to a full ring
+  struct trevent ev[TR_NRING];
+};
+
+static struct trring rings[NCPU];
+static struct sleeplock readlock;
+
+volatile uint32 ktrace_mask;
+
+void
+ktraceinit(void)
+{
+  initsleeplock(&readlock, "ktrace");
+}
+
+void
+ktrace_emit(int id, uint64 a0, uint64 a1)
+{
+  struct trring *r;
+  struct trevent *e;
+  struct proc *p;
+
+  push_off();
+  r = &rings[cpuid()];
+  if(r->head - r->tail == TR_NRING){
+    r->drop++;
+    pop_off();
+    return;
+  }
+  p = mycpu()->proc;
+  e = &r->ev[r->head % TR_NRING];
+  e->time = r_time();
+  e->id = id;
+  e->hart = cpuid();
+  e->pid = p ? p->pid : 0;
+  e->a0 = a0;
+  e->a1 = a1;
+  __sync_synchronize();     // the record before the head that covers it
+  r->head++;
+  pop_off();
+}
+
+// Copy up to n records to user address addr, taking from each hart
+// in turn. Returns how many, or -1.
+static int
+ktraceread(uint64 addr, int n)
+{
+  struct trevent e;
+  struct trring *r;
+  int got = 0, more = 1;
+
+  acquiresleep(&readlock);
+  while(got < n && more){
+    more = 0;
+    for(r = rings; r < rings + NCPU && got < n; r++){
+      if(r->tail == r->head)
+        continue;
+      __sync_synchronize(); // the head before the record it covers
+      e = r->ev[r->tail % TR_NRING];
+      __sync_synchronize(); // done with the record before freeing it
+      r->tail++;
+      if(copyout2(addr + got * sizeof(e), (char *)&e, sizeof(e)) < 0){
+        releasesleep(&readlock);
+        return -1;
+      }
+      got++;
+      more = 1;
+    }
+  }
+  releasesleep(&readlock);
+  return got;
+}
+
+int
+ktracectl(int cmd, uint64 addr, int n)
+{
+  struct trring *r;
+  uint64 drop = 0;
+
+  switch(cmd){
+  case KTRACE_START:
+    // only readers move tails, so this can't race with ktrace_emit()
+    acquiresleep(&readlock);
+    for(r = rings; r < rings + NCPU; r++){
+      r->tail = r->head;
+      r->drop = 0;
+    }
+    releasesleep(&readlock);
+    ktrace_mask = n & TR_ALL;
+    return 0;
+  case KTRACE_STOP:
+    ktrace_mask = 0;
+    for(r = rings; r < rings + NCPU; r++)
+      drop += r->drop;
+    return drop;
+  case KTRACE_READ:
+    return ktraceread(addr, n);
+  }
+  return -1;
+}
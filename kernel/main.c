@@ -16,6 +16,9 @@
 #include "../libs/vm.h"
 #include "../libs/disk.h"
 #include "../libs/buf.h"
+#include "../libs/slab.h"
+#include "../libs/pipe.h"
+#include "../libs/ktrace.h"
 #ifndef QEMU
 #include "../libs/sdcard.h"
 #include "../libs/fpioa.h"
@@ -41,9 +44,12 @@ main(unsigned long hartid, unsigned long dtb_pa)
     printf("hart %d enter main()...\n", hartid);
     #endif
     kinit();         // physical page allocator
+    slabinit();      // kmalloc caches
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     timerinit();     // init a lock for timer
+    profinit();      // sampling profiler rings
+    ktraceinit();    // event trace
     trapinithart();  // install kernel trap vector, including interrupt handler
     procinit();
     plicinit();
@@ -55,7 +61,12 @@ main(unsigned long hartid, unsigned long dtb_pa)
     disk_init();
     binit();         // buffer cache
     fileinit();      // file table
+    pipeinit();      // pipe cache
     userinit();      // first user process
+    if(kthread("bflushd", bflushd) < 0)   // buffer cache flusher
+      panic("bflushd");
+    if(kthread("breadd", breadd) < 0)     // read-ahead
+      panic("breadd");
     printf("hart 0 init done\n");
     
     for(int i = 1; i < NCPU; i++) {
@@ -13,6 +13,7 @@
 #include "../libs/file.h"
 #include "../libs/trap.h"
 #include "../libs/vm.h"
+#include "../libs/ktrace.h"
 
 
 struct cpu cpus[NCPU];
@@ -346,7 +347,7 @@ fork(void)
   }
 
   // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, np->kpagetable, p->sz) < 0){
+  if(uvmcopy(p->pagetable, p->kpagetable, np->pagetable, np->kpagetable, p->sz) < 0){
     freeproc(np);
     release(&np->lock);
     return -1;
@@ -381,6 +382,48 @@ fork(void)
   return pid;
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kthreadret.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  p->kfn();
+  panic("kthread return");
+}
+
+// Create a process that runs fn in the kernel and never
+// returns to user space, for daemons that need to sleep.
+// fn must not return.
+// Returns the new pid, or -1 if out of memory.
+int
+kthread(char *name, void (*fn)(void))
+{
+  int pid;
+  struct proc *np;
+
+  if((np = allocproc()) == NULL){
+    return -1;
+  }
+
+  np->kfn = fn;
+  np->context.ra = (uint64)kthreadret;
+  np->tmask = 0;
+  safestrcpy(np->name, name, sizeof(np->name));
+
+  pid = np->pid;
+
+  np->state = RUNNABLE;
+
+  release(&np->lock);
+
+  return pid;
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold p->lock.
 void
@@ -553,11 +596,13 @@ scheduler(void)
         // printf("[scheduler]found runnable proc with pid: %d\n", p->pid);
         p->state = RUNNING;
         c->proc = p;
+        ktrace(TR_SWTCHIN, 0, 0);
         w_satp(MAKE_SATP(p->kpagetable));
         sfence_vma();
         swtch(&c->context, &p->context);
         w_satp(MAKE_SATP(kernel_pagetable));
         sfence_vma();
+        ktrace(TR_SWTCHOUT, p->state, 0);
         // Process is done running for now.
         // It should have changed its p->state before coming back.
         c->proc = 0;
@@ -567,6 +612,10 @@ scheduler(void)
       release(&p->lock);
     }
     if(found == 0) {
+      // nothing to run: zero pages for kalloc_zeroed(), and wait
+      // for an interrupt only once the pool is full
+      if(kzero_fill() > 0)
+        continue;
       intr_on();
       asm volatile("wfi");
     }
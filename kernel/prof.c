@@ -0,0 +1,177 @@
+// Sampling profiler.
+//
+// While it is on, each timer interrupt records where its hart was:
+// the interrupted pc, and the return addresses found by following the
+// frame pointer chain (everything is built with -fno-omit-frame-pointer),
+// in kernel or user mode. Samples go into a ring per hart, and
+// prof(PROF_READ) drains them. user/prof.c writes them out as text, and
+// tools/profsym.py turns that into folded stacks for a flame graph.
+
+#include "../libs/types.h"
+#include "../libs/param.h"
+#include "../libs/memlayout.h"
+#include "../libs/riscv.h"
+#include "../libs/spinlock.h"
+#include "../libs/proc.h"
+#include "../libs/string.h"
+#include "../libs/vm.h"
+#include "../libs/timer.h"
+#include "../libs/prof.h"
+
+#define PROF_NRING    256   // samples per hart, about a second of them
+
+struct profring {
+  struct spinlock lock;
+  uint head;                // samples [tail, head) are waiting,
+  uint tail;                // at index mod PROF_NRING
+  uint64 drop;              // samples lost to a full ring
+  struct profsample s[PROF_NRING];
+};
+
+static struct profring rings[NCPU];
+static volatile int profon;
+
+extern char etext[];
+
+void
+profinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&rings[i].lock, "prof");
+}
+
+// Follow the frame pointer chain from fp on a kernel stack, which
+// takes one page. A leaf function doesn't save ra, so interrupting
+// one ends the chain at the interrupted pc.
+static int
+kwalk(uint64 fp, uint64 *pc, int n)
+{
+  uint64 lo = PGROUNDDOWN(fp - 1), hi = lo + PGSIZE;
+  uint64 ra, next;
+  int i = 0;
+
+  while(i < n && fp % 8 == 0 && fp >= lo + 16 && fp <= hi){
+    ra = ((uint64 *)fp)[-1];
+    if(ra < KERNBASE || ra >= (uint64)etext)
+      break;
+    pc[i++] = ra;
+    next = ((uint64 *)fp)[-2];
+    if(next <= fp)
+      break;
+    fp = next;
+  }
+  return i;
+}
+
+// The same for a user stack, read through the page table, which
+// only fails on unmapped pages.
+static int
+uwalk(struct proc *p, uint64 fp, uint64 *pc, int n)
+{
+  uint64 fr[2];             // saved fp, ra
+  int i = 0;
+
+  while(i < n && fp % 8 == 0 && fp >= 16 && fp <= p->sz){
+    if(copyin(p->pagetable, (char *)fr, fp - 16, sizeof(fr)) < 0)
+      break;
+    if(fr[1] >= p->sz)
+      break;
+    pc[i++] = fr[1];
+    if(fr[0] <= fp)
+      break;
+    fp = fr[0];
+  }
+  return i;
+}
+
+// Called from the timer interrupt with the interrupted pc and s0.
+// Interrupts are off.
+void
+profsample(int user, uint64 pc, uint64 fp)
+{
+  if(!profon)
+    return;
+
+  struct proc *p = myproc();
+  struct profring *r = &rings[cpuid()];
+  struct profsample *s;
+
+  acquire(&r->lock);
+  if(r->head - r->tail == PROF_NRING){
+    r->drop++;
+    release(&r->lock);
+    return;
+  }
+  s = &r->s[r->head % PROF_NRING];
+  s->pid = p ? p->pid : 0;
+  s->hart = cpuid();
+  s->user = user;
+  safestrcpy(s->name, p ? p->name : "-", sizeof(s->name));
+  s->pc[0] = pc;
+  if(user)
+    s->depth = 1 + uwalk(p, fp, s->pc + 1, PROF_DEPTH - 1);
+  else
+    s->depth = 1 + kwalk(fp, s->pc + 1, PROF_DEPTH - 1);
+  r->head++;
+  release(&r->lock);
+}
+
+// Copy up to n samples to user address addr, taking from each hart
+// in turn. Returns how many, or -1.
+static int
+profread(uint64 addr, int n)
+{
+  struct profsample s;
+  struct profring *r;
+  int got = 0, more = 1;
+
+  while(got < n && more){
+    more = 0;
+    for(int i = 0; i < NCPU && got < n; i++){
+      r = &rings[i];
+      acquire(&r->lock);
+      if(r->tail == r->head){
+        release(&r->lock);
+        continue;
+      }
+      s = r->s[r->tail % PROF_NRING];
+      r->tail++;
+      release(&r->lock);
+      if(copyout2(addr + got * sizeof(s), (char *)&s, sizeof(s)) < 0)
+        return -1;
+      got++;
+      more = 1;
+    }
+  }
+  return got;
+}
+
+int
+profctl(int cmd, uint64 addr, int n)
+{
+  struct profring *r;
+  uint64 drop = 0;
+
+  switch(cmd){
+  case PROF_START:
+    for(r = rings; r < rings + NCPU; r++){
+      acquire(&r->lock);
+      r->head = r->tail = 0;
+      r->drop = 0;
+      release(&r->lock);
+    }
+    profon = 1;
+    return 0;
+  case PROF_STOP:
+    profon = 0;
+    for(r = rings; r < rings + NCPU; r++){
+      acquire(&r->lock);
+      drop += r->drop;
+      release(&r->lock);
+    }
+    return drop;
+  case PROF_READ:
+    return profread(addr, n);
+  }
+  return -1;
+}
@@ -0,0 +1,257 @@
+// Slab allocator for small kernel objects.
+//
+// A kmem_cache hands out objects of one size, carved out of pages
+// from kalloc(). Each page (a slab) starts with a struct slab, and
+// keeps its free objects on a list threaded through them. Each hart
+// has a magazine of a few objects per cache that it takes from and
+// frees to with interrupts off but no lock; the cache lock is only
+// taken to refill or flush half a magazine at a time.
+//
+// A slab whose objects are all free is kept as the cache's one empty
+// slab, or else given back to kalloc() at once. kmem_cache_reap()
+// gives back those kept slabs as well, when memory runs out.
+//
+// kmalloc() serves sizes up to KMALLOC_MAX from a cache per power
+// of two.
+
+#include "../libs/types.h"
+#include "../libs/param.h"
+#include "../libs/riscv.h"
+#include "../libs/spinlock.h"
+#include "../libs/intr.h"
+#include "../libs/proc.h"
+#include "../libs/kalloc.h"
+#include "../libs/printf.h"
+#include "../libs/slab.h"
+
+struct slab {
+  struct kmem_cache *cache;
+  struct slab *next;        // on one of the cache's lists
+  struct slab **pprev;      // the pointer to this one on that list
+  void *free;               // free objects, linked through their first word
+  uint inuse;
+};
+
+#define SLAB_HDR      ((sizeof(struct slab) + 7) & ~7)
+
+static struct spinlock cacheslock;
+static struct kmem_cache *caches;
+
+#define KMALLOC_MIN   32
+#define NKMALLOC      7     // 32 .. 2048
+
+static struct kmem_cache kmcache[NKMALLOC];
+static char *kmnames[NKMALLOC] = {
+  "kmalloc-32", "kmalloc-64", "kmalloc-128", "kmalloc-256",
+  "kmalloc-512", "kmalloc-1024", "kmalloc-2048",
+};
+
+void
+slabinit(void)
+{
+  initlock(&cacheslock, "caches");
+  for(int i = 0; i < NKMALLOC; i++)
+    kmem_cache_init(&kmcache[i], kmnames[i], KMALLOC_MIN << i);
+}
+
+void
+kmem_cache_init(struct kmem_cache *c, char *name, uint size)
+{
+  size = (size + 7) & ~7;
+  if(size < sizeof(void *) || size > PGSIZE - SLAB_HDR)
+    panic("kmem_cache_init");
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - SLAB_HDR) / size;
+  c->partial = c->full = c->empty = 0;
+  c->nslab = 0;
+  for(int i = 0; i < NCPU; i++)
+    c->mag[i].n = 0;
+  acquire(&cacheslock);
+  c->next = caches;
+  caches = c;
+  release(&cacheslock);
+}
+
+static void
+slab_unlink(struct slab *s)
+{
+  if((*s->pprev = s->next) != 0)
+    s->next->pprev = s->pprev;
+}
+
+static void
+slab_link(struct slab **list, struct slab *s)
+{
+  if((s->next = *list) != 0)
+    s->next->pprev = &s->next;
+  s->pprev = list;
+  *list = s;
+}
+
+// Set up a page as an empty slab of c.
+static struct slab *
+slab_new(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *p;
+
+  if((s = kalloc()) == 0)
+    return 0;
+  s->cache = c;
+  s->inuse = 0;
+  s->free = 0;
+  for(uint i = c->perslab; i > 0; i--){
+    p = (char *)s + SLAB_HDR + (i - 1) * c->size;
+    *(void **)p = s->free;
+    s->free = p;
+  }
+  return s;
+}
+
+// Take an object out of the slabs c has, or return 0.
+// Caller must hold c->lock.
+static void *
+slab_take(struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  if((s = c->partial) == 0){
+    if((s = c->empty) == 0)
+      return 0;
+    c->empty = 0;
+    slab_link(&c->partial, s);
+  }
+  obj = s->free;
+  s->free = *(void **)obj;
+  if(++s->inuse == c->perslab){
+    slab_unlink(s);
+    slab_link(&c->full, s);
+  }
+  return obj;
+}
+
+// Put an object back into its slab. Caller must hold c->lock.
+static void
+slab_put(struct kmem_cache *c, void *obj)
+{
+  struct slab *s = (struct slab *)PGROUNDDOWN((uint64)obj);
+
+  if(s->cache != c)
+    panic("slab_put");
+  *(void **)obj = s->free;
+  s->free = obj;
+  if(s->inuse-- == c->perslab){
+    slab_unlink(s);
+    slab_link(&c->partial, s);
+  }
+  if(s->inuse == 0){
+    slab_unlink(s);
+    if(c->empty == 0){
+      c->empty = s;
+      s->next = 0;
+      s->pprev = &c->empty;
+    } else {
+      c->nslab--;
+      kfree(s);
+    }
+  }
+}
+
+void *
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct kmem_mag *m;
+  struct slab *s;
+  void *obj = 0;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == 0){
+    acquire(&c->lock);
+    for(;;){
+      while(m->n < SLAB_MAG / 2 && (obj = slab_take(c)) != 0)
+        m->obj[m->n++] = obj;
+      if(m->n > 0)
+        break;
+      // not under c->lock, as kalloc() may reap the caches
+      release(&c->lock);
+      s = slab_new(c);
+      acquire(&c->lock);
+      if(s == 0)
+        break;
+      slab_link(&c->partial, s);
+      c->nslab++;
+    }
+    release(&c->lock);
+  }
+  obj = m->n > 0 ? m->obj[--m->n] : 0;
+  pop_off();
+  return obj;
+}
+
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct kmem_mag *m;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == SLAB_MAG){
+    acquire(&c->lock);
+    while(m->n > SLAB_MAG / 2)
+      slab_put(c, m->obj[--m->n]);
+    release(&c->lock);
+  }
+  m->obj[m->n++] = obj;
+  pop_off();
+}
+
+// Give the empty slabs the caches keep back to kalloc(). The objects
+// in magazines stay where they are, as only their harts touch them.
+// Returns the number of pages freed.
+int
+kmem_cache_reap(void)
+{
+  struct kmem_cache *c;
+  struct slab *s;
+  int n = 0;
+
+  acquire(&cacheslock);
+  for(c = caches; c != 0; c = c->next){
+    acquire(&c->lock);
+    if((s = c->empty) != 0){
+      c->empty = 0;
+      c->nslab--;
+    }
+    release(&c->lock);
+    if(s){
+      kfree(s);
+      n++;
+    }
+  }
+  release(&cacheslock);
+  return n;
+}
+
+void *
+kmalloc(uint size)
+{
+  int i;
+
+  if(size > KMALLOC_MAX)
+    return 0;
+  for(i = 0; (KMALLOC_MIN << i) < size; i++)
+    ;
+  return kmem_cache_alloc(&kmcache[i]);
+}
+
+void
+kmfree(void *obj)
+{
+  struct slab *s = (struct slab *)PGROUNDDOWN((uint64)obj);
+
+  kmem_cache_free(s->cache, obj);
+}
@@ -30,6 +30,22 @@ acquiresleep(struct sleeplock *lk)
   release(&lk->lk);
 }
 
+// Take the lock only if no one holds it; returns 1 on success.
+int
+tryacquiresleep(struct sleeplock *lk)
+{
+  int r;
+
+  acquire(&lk->lk);
+  r = !lk->locked;
+  if (r) {
+    lk->locked = 1;
+    lk->pid = myproc()->pid;
+  }
+  release(&lk->lk);
+  return r;
+}
+
 void
 releasesleep(struct sleeplock *lk)
 {
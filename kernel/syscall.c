@@ -11,6 +11,7 @@
 #include "../libs/vm.h"
 #include "../libs/string.h"
 #include "../libs/printf.h"
+#include "../libs/ktrace.h"
 
 // Fetch the uint64 at addr from the current process.
 int
@@ -116,6 +117,15 @@ extern uint64 sys_remove(void);
 extern uint64 sys_trace(void);
 extern uint64 sys_sysinfo(void);
 extern uint64 sys_rename(void);
+extern uint64 sys_iostat(void);
+extern uint64 sys_sync(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_lseek(void);
+extern uint64 sys_statfs(void);
+extern uint64 sys_getdents64(void);
+extern uint64 sys_fallocate(void);
+extern uint64 sys_prof(void);
+extern uint64 sys_ktrace(void);
 
 static uint64 (*syscalls[])(void) = {
   [SYS_fork]        sys_fork,
@@ -144,6 +154,15 @@ static uint64 (*syscalls[])(void) = {
   [SYS_trace]       sys_trace,
   [SYS_sysinfo]     sys_sysinfo,
   [SYS_rename]      sys_rename,
+  [SYS_iostat]      sys_iostat,
+  [SYS_sync]        sys_sync,
+  [SYS_fsync]       sys_fsync,
+  [SYS_lseek]       sys_lseek,
+  [SYS_statfs]      sys_statfs,
+  [SYS_getdents64]  sys_getdents64,
+  [SYS_fallocate]   sys_fallocate,
+  [SYS_prof]        sys_prof,
+  [SYS_ktrace]      sys_ktrace,
 };
 
 static char *sysnames[] = {
@@ -173,6 +192,15 @@ static char *sysnames[] = {
   [SYS_trace]       "trace",
   [SYS_sysinfo]     "sysinfo",
   [SYS_rename]      "rename",
+  [SYS_iostat]      "iostat",
+  [SYS_sync]        "sync",
+  [SYS_fsync]       "fsync",
+  [SYS_lseek]       "lseek",
+  [SYS_statfs]      "statfs",
+  [SYS_getdents64]  "getdents64",
+  [SYS_fallocate]   "fallocate",
+  [SYS_prof]        "prof",
+  [SYS_ktrace]      "ktrace",
 };
 
 void
@@ -183,9 +211,11 @@ syscall(void)
 
   num = p->trapframe->a7;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    ktrace(TR_SYSCALL, num, p->trapframe->a0);
     p->trapframe->a0 = syscalls[num]();
-        // trace
-    if ((p->tmask & (1 << num)) != 0) {
+    ktrace(TR_SYSRET, num, p->trapframe->a0);
+        // trace, only calls below 32 fit in the mask; ktrace has them all
+    if (num < 32 && (p->tmask & (1 << num)) != 0) {
       printf("pid %d: %s -> %d\n", p->pid, sysnames[num], p->trapframe->a0);
     }
   } else {
@@ -216,6 +246,7 @@ sys_sysinfo(void)
   struct sysinfo info;
   info.freemem = freemem_amount();
   info.nproc = procnum();
+  kalloc_stat(info.freeblk);
 
   // if (copyout(p->pagetable, addr, (char *)&info, sizeof(info)) < 0) {
   if (copyout2(addr, (char *)&info, sizeof(info)) < 0) {
@@ -20,6 +20,9 @@
 #include "../libs/string.h"
 #include "../libs/printf.h"
 #include "../libs/vm.h"
+#include "../libs/buf.h"
+#include "../libs/iostat.h"
+#include "../libs/statfs.h"
 
 
 // Fetch the nth word-sized system call argument as a file descriptor
@@ -84,6 +87,28 @@ sys_read(void)
   return fileread(f, p, n);
 }
 
+uint64
+sys_lseek(void)
+{
+  struct file *f;
+  int off, whence;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &off) < 0 || argint(2, &whence) < 0)
+    return -1;
+  return fileseek(f, off, whence);
+}
+
+uint64
+sys_fallocate(void)
+{
+  struct file *f;
+  int mode, off, len;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &mode) < 0 || argint(2, &off) < 0 || argint(3, &len) < 0)
+    return -1;
+  return filefalloc(f, mode, off, len);
+}
+
 uint64
 sys_write(void)
 {
@@ -121,13 +146,14 @@ sys_fstat(void)
   return filestat(f, st);
 }
 
+// Relative paths start at base, or at the cwd if base is NULL.
 static struct dirent*
-create(char *path, short type, int mode)
+create(struct dirent *base, char *path, short type, int mode)
 {
   struct dirent *ep, *dp;
   char name[FAT32_MAX_FILENAME + 1];
 
-  if((dp = enameparent(path, name)) == NULL)
+  if((dp = enameparentat(base, path, name)) == NULL)
     return NULL;
 
   if (type == T_DIR) {
@@ -160,24 +186,56 @@ create(char *path, short type, int mode)
   return ep;
 }
 
+// openat(dirfd, path, flags, mode) shares its number with open(path, flags).
+// A user string never lives below NOFILE, so a first argument that is
+// AT_FDCWD or a descriptor means openat. Returns the argument index of
+// the path, and the base directory in *pbase (NULL for the cwd).
+static int
+argopenat(struct dirent **pbase)
+{
+  uint64 a;
+  struct file *f;
+
+  *pbase = NULL;
+  if(argaddr(0, &a) < 0)
+    return -1;
+  if((long)a == AT_FDCWD)
+    return 1;
+  if(a >= NOFILE)
+    return 0;
+  if(argfd(0, 0, &f) < 0 || f->type != FD_ENTRY ||
+      !(f->ep->attribute & ATTR_DIRECTORY))
+    return -1;
+  *pbase = f->ep;
+  return 1;
+}
+
 uint64
 sys_open(void)
 {
   char path[FAT32_MAX_PATH];
-  int fd, omode;
+  int fd, omode, argp;
   struct file *f;
-  struct dirent *ep;
+  struct dirent *ep, *base;
 
-  if(argstr(0, path, FAT32_MAX_PATH) < 0 || argint(1, &omode) < 0)
+  if((argp = argopenat(&base)) < 0 ||
+      argstr(argp, path, FAT32_MAX_PATH) < 0 || argint(argp + 1, &omode) < 0)
     return -1;
+  if(argp){
+    // Linux flags to ours
+    omode = (omode & (O_WRONLY | O_RDWR)) |
+            ((omode & LO_CREAT) ? O_CREATE : 0) |
+            ((omode & LO_TRUNC) ? O_TRUNC : 0) |
+            ((omode & LO_APPEND) ? O_APPEND : 0);
+  }
 
   if(omode & O_CREATE){
-    ep = create(path, T_FILE, omode);
+    ep = create(base, path, T_FILE, omode);
     if(ep == NULL){
       return -1;
     }
   } else {
-    if((ep = ename(path)) == NULL){
+    if((ep = enameat(base, path)) == NULL){
       return -1;
     }
     elock(ep);
@@ -203,6 +261,9 @@ sys_open(void)
 
   f->type = FD_ENTRY;
   f->off = (omode & O_APPEND) ? ep->file_size : 0;
+  f->ra_next = f->ra_end = f->off;
+  f->ra_win = 0;
+  f->cur_clus = f->clus_cnt = f->clus_gen = 0;
   f->ep = ep;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
@@ -218,7 +279,7 @@ sys_mkdir(void)
   char path[FAT32_MAX_PATH];
   struct dirent *ep;
 
-  if(argstr(0, path, FAT32_MAX_PATH) < 0 || (ep = create(path, T_DIR, 0)) == 0){
+  if(argstr(0, path, FAT32_MAX_PATH) < 0 || (ep = create(NULL, path, T_DIR, 0)) == 0){
     return -1;
   }
   eunlock(ep);
@@ -328,6 +389,18 @@ sys_readdir(void)
   return dirnext(f, p);
 }
 
+uint64
+sys_getdents64(void)
+{
+  struct file *f;
+  uint64 p;
+  int n;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 || n < 0)
+    return -1;
+  return filegetdents(f, p, n);
+}
+
 // get absolute cwd string
 uint64
 sys_getcwd(void)
@@ -472,6 +545,7 @@ sys_rename(void)
   src->parent = edup(pdst);
   src->off = off;
   src->valid = 1;
+  erehash(src);
   eunlock(src);
 
   eput(psrc);
@@ -494,3 +568,71 @@ fail:
     eput(src);
   return -1;
 }
+
+// Write all dirty buffers back to disk.
+uint64
+sys_sync(void)
+{
+  fat32_sync();
+  bsync();
+  return 0;
+}
+
+// Write the file's directory entry into its buffer,
+// then force all dirty buffers out.
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+  struct dirent *ep;
+
+  if(argfd(0, 0, &f) < 0 || f->type != FD_ENTRY)
+    return -1;
+  ep = f->ep;
+  elock(ep);
+  if(ep->parent){         // root has no entry to update
+    elock(ep->parent);
+    eupdate(ep);
+    eunlock(ep->parent);
+  }
+  eunlock(ep);
+  fat32_sync();
+  bsync();
+  return 0;
+}
+
+// Size and free space of the file system holding path.
+uint64
+sys_statfs(void)
+{
+  char path[FAT32_MAX_PATH];
+  uint64 addr;
+  struct dirent *ep;
+  struct statfs st;
+
+  if(argstr(0, path, FAT32_MAX_PATH) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  if((ep = ename(path)) == NULL)
+    return -1;
+  eput(ep);
+  fat32_statfs(&st);
+  if(copyout2(addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// Block I/O counters, for the iostat tool.
+uint64
+sys_iostat(void)
+{
+  uint64 addr;
+  struct iostat st;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  bstat(&st);
+  fat32_iostat(&st);
+  if(copyout2(addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
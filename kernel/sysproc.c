@@ -10,6 +10,7 @@
 #include "../libs/kalloc.h"
 #include "../libs/string.h"
 #include "../libs/printf.h"
+#include "../libs/ktrace.h"
 
 extern int exec(char *path, char **argv);
 
@@ -153,4 +154,28 @@ sys_trace(void)
   }
   myproc()->tmask = mask;
   return 0;
-}
\ No newline at end of file
+}
+
+// Sampling profiler, see prof.c.
+uint64
+sys_prof(void)
+{
+  int cmd, n;
+  uint64 addr;
+
+  if(argint(0, &cmd) < 0 || argaddr(1, &addr) < 0 || argint(2, &n) < 0)
+    return -1;
+  return profctl(cmd, addr, n);
+}
+
+// Kernel event trace, see ktrace.c.
+uint64
+sys_ktrace(void)
+{
+  int cmd, n;
+  uint64 addr;
+
+  if(argint(0, &cmd) < 0 || argaddr(1, &addr) < 0 || argint(2, &n) < 0)
+    return -1;
+  return ktracectl(cmd, addr, n);
+}
@@ -9,6 +9,7 @@
 #include "../libs/timer.h"
 #include "../libs/printf.h"
 #include "../libs/proc.h"
+#include "../libs/buf.h"
 
 struct spinlock tickslock;
 uint ticks;
@@ -32,9 +33,14 @@ set_next_timeout() {
 }
 
 void timer_tick() {
+    int flush;
+
     acquire(&tickslock);
     ticks++;
     wakeup(&ticks);
+    flush = (ticks % FLUSHTICKS == 0);
     release(&tickslock);
+    if (flush)
+        bkick();
     set_next_timeout();
 }
@@ -12,6 +12,7 @@
 #include "../libs/console.h"
 #include "../libs/timer.h"
 #include "../libs/disk.h"
+#include "../libs/vm.h"
 
 extern char trampoline[], uservec[], userret[];
 
@@ -77,6 +78,9 @@ usertrap(void)
     intr_on();
     syscall();
   } 
+  else if(r_scause() == 15 && uvmcow(p->pagetable, p->kpagetable, r_stval()) == 0){
+    // store to a copy-on-write page, which is ours to write now
+  }
   else if((which_dev = devintr()) != 0){
     // ok
   } 
@@ -91,8 +95,10 @@ usertrap(void)
     exit(-1);
 
   // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  if(which_dev == 2){
+    profsample(1, p->trapframe->epc, p->trapframe->s0);
     yield();
+  }
 
   usertrapret();
 }
@@ -167,6 +173,10 @@ kerneltrap() {
     panic("kerneltrap");
   }
   // printf("which_dev: %d\n", which_dev);
+  // kernelvec leaves s0 alone, so the s0 saved by our prologue,
+  // just under our frame pointer, is that of the interrupted code.
+  if(which_dev == 2)
+    profsample(0, sepc, ((uint64 *)r_fp())[-2]);
   
   // give up the CPU if this is a timer interrupt.
   if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING) {
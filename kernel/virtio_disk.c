@@ -45,6 +45,19 @@ static struct disk {
     struct buf *b;
     char status;
   } info[NUM];
+
+  // the buf whose data a descriptor carries,
+  // so a multi-sector chain can be finished as a whole.
+  struct buf *dbuf[NUM];
+
+  // request headers, indexed by first descriptor index of chain.
+  // they live here rather than on the submitter's stack, since
+  // the submitter may return before the request completes.
+  struct virtio_blk_outhdr {
+    uint32 type;
+    uint32 reserved;
+    uint64 sector;
+  } ops[NUM];
   
   struct spinlock vdisk_lock;
   
@@ -142,10 +155,10 @@ free_desc(int i)
     panic("virtio_disk_intr 2");
   disk.desc[i].addr = 0;
   disk.free[i] = 1;
-  wakeup(&disk.free[0]);
 }
 
 // free a chain of descriptors.
+// the caller wakes up whoever waits for descriptors.
 static void
 free_chain(int i)
 {
@@ -158,10 +171,11 @@ free_chain(int i)
   }
 }
 
+// allocate n descriptors, all or nothing.
 static int
-alloc3_desc(int *idx)
+alloc_descs(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -175,64 +189,85 @@ alloc3_desc(int *idx)
 void
 virtio_disk_rw(struct buf *b, int write)
 {
-  uint64 sector = b->sectorno;
+  virtio_disk_rwv(&b, 1, write);
+}
+
+void
+virtio_disk_rwv(struct buf **bufs, int n, int write)
+{
+  virtio_disk_submit(bufs, n, write);
+  virtio_disk_wait(bufs[0]);
+}
+
+// start reading or writing the n sectors starting at
+// bufs[0]->sectorno with a single request, and return without
+// waiting for it; bufs[i] holds sector bufs[0]->sectorno + i.
+// the caller must keep the bufs locked until virtio_disk_wait(bufs[0]).
+void
+virtio_disk_submit(struct buf **bufs, int n, int write)
+{
+  uint64 sector = bufs[0]->sectorno;
+
+  if(n < 1 || n > MAXBVEC)
+    panic("virtio_disk_submit");
 
   acquire(&disk.vdisk_lock);
 
-  // the spec says that legacy block operations use three
-  // descriptors: one for type/reserved/sector, one for
-  // the data, one for a 1-byte status result.
+  // the spec says that legacy block operations use one
+  // descriptor for type/reserved/sector, then one per data
+  // segment, then one for a 1-byte status result.
 
-  // allocate the three descriptors.
-  int idx[3];
+  // allocate the n + 2 descriptors.
+  int idx[MAXBVEC + 2];
   while(1){
-    if(alloc3_desc(idx) == 0) {
+    if(alloc_descs(idx, n + 2) == 0) {
       break;
     }
     sleep(&disk.free[0], &disk.vdisk_lock);
   }
   
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_outhdr {
-    uint32 type;
-    uint32 reserved;
-    uint64 sector;
-  } buf0;
+  struct virtio_blk_outhdr *buf0 = &disk.ops[idx[0]];
 
   if(write)
-    buf0.type = VIRTIO_BLK_T_OUT; // write the disk
+    buf0->type = VIRTIO_BLK_T_OUT; // write the disk
   else
-    buf0.type = VIRTIO_BLK_T_IN; // read the disk
-  buf0.reserved = 0;
-  buf0.sector = sector;
-
-  // buf0 is on a kernel stack, which is not direct mapped,
-  // thus the call to kvmpa().
-  disk.desc[idx[0]].addr = (uint64) kwalkaddr(myproc()->kpagetable, (uint64) &buf0);
-  disk.desc[idx[0]].len = sizeof(buf0);
+    buf0->type = VIRTIO_BLK_T_IN; // read the disk
+  buf0->reserved = 0;
+  buf0->sector = sector;
+
+  disk.desc[idx[0]].addr = (uint64) buf0;
+  disk.desc[idx[0]].len = sizeof(*buf0);
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  // one data segment per buffer.
+  for(int i = 0; i < n; i++){
+    int d = idx[i + 1];
+    disk.desc[d].addr = (uint64) bufs[i]->data;
+    disk.desc[d].len = BSIZE;
+    if(write)
+      disk.desc[d].flags = 0; // device reads b->data
+    else
+      disk.desc[d].flags = VRING_DESC_F_WRITE; // device writes b->data
+    disk.desc[d].flags |= VRING_DESC_F_NEXT;
+    disk.desc[d].next = idx[i + 2];
+
+    // record struct buf for virtio_disk_intr().
+    bufs[i]->disk = 1;
+    disk.dbuf[d] = bufs[i];
+  }
 
+  int st = idx[n + 1];
   disk.info[idx[0]].status = 0;
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  disk.desc[st].addr = (uint64) &disk.info[idx[0]].status;
+  disk.desc[st].len = 1;
+  disk.desc[st].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[st].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  disk.info[idx[0]].b = bufs[0];
 
   // avail[0] is flags
   // avail[1] tells the device how far to look in avail[2...].
@@ -244,14 +279,18 @@ virtio_disk_rw(struct buf *b, int write)
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
-  // Wait for virtio_disk_intr() to say request has finished.
+  release(&disk.vdisk_lock);
+}
+
+// wait for the request that b leads to finish.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
+  // virtio_disk_intr() finishes all the buffers of a request at once.
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
-
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
-
   release(&disk.vdisk_lock);
 }
 
@@ -260,18 +299,38 @@ virtio_disk_intr()
 {
   acquire(&disk.vdisk_lock);
 
+  // ack first, so that a request that completes while we
+  // are going through the used ring raises a new interrupt.
+  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+  __sync_synchronize();
+
+  // finish every request the device has completed so far,
+  // and give their descriptors back in one go.
+  int done = 0;
   while((disk.used_idx % NUM) != (disk.used->id % NUM)){
     int id = disk.used->elems[disk.used_idx].id;
 
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
     
-    disk.info[id].b->disk = 0;   // disk is done with buf
+    // disk is done with every buf of the chain.
+    for(int d = id; ; d = disk.desc[d].next){
+      if(disk.dbuf[d] != 0){
+        disk.dbuf[d]->disk = 0;
+        disk.dbuf[d] = 0;
+      }
+      if(!(disk.desc[d].flags & VRING_DESC_F_NEXT))
+        break;
+    }
     wakeup(disk.info[id].b);
+    disk.info[id].b = 0;
+    free_chain(id);
+    done++;
 
     disk.used_idx = (disk.used_idx + 1) % NUM;
   }
-  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+  if(done)
+    wakeup(&disk.free[0]);
 
   release(&disk.vdisk_lock);
 }
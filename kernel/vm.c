@@ -22,11 +22,9 @@ extern char trampoline[]; // trampoline.S
 void
 kvminit()
 {
-  kernel_pagetable = (pagetable_t) kalloc();
+  kernel_pagetable = (pagetable_t) kalloc_zeroed();
   // printf("kernel_pagetable: %p\n", kernel_pagetable);
 
-  memset(kernel_pagetable, 0, PGSIZE);
-
   // uart registers
   kvmmap(UART_V, UART, PGSIZE, PTE_R | PTE_W);
   
@@ -123,9 +121,8 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
     if(*pte & PTE_V) {
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == NULL)
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == NULL)
         return NULL;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
@@ -251,10 +248,9 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloc_zeroed();
   if(pagetable == NULL)
     return NULL;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -268,9 +264,8 @@ uvminit(pagetable_t pagetable, pagetable_t kpagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
+  mem = kalloc_zeroed();
   // printf("[uvminit]kalloc: %p\n", mem);
-  memset(mem, 0, PGSIZE);
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   mappages(kpagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X);
   memmove(mem, src, sz);
@@ -292,12 +287,11 @@ uvmalloc(pagetable_t pagetable, pagetable_t kpagetable, uint64 oldsz, uint64 new
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == NULL){
       uvmdealloc(pagetable, kpagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if (mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0) {
       kfree(mem);
       uvmdealloc(pagetable, kpagetable, a, oldsz);
@@ -362,19 +356,19 @@ uvmfree(pagetable_t pagetable, uint64 sz)
   freewalk(pagetable);
 }
 
-// Given a parent process's page table, copy
-// its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Given a parent process's page table and its
+// kernel mirror, share its memory with a child's.
+// Writable pages become read-only and copy-on-write
+// in all four tables; the first store to one makes
+// a copy (uvmcow), so no memory is copied here.
 // returns 0 on success, -1 on failure.
-// frees any allocated pages on failure.
+// unmaps what it mapped on failure.
 int
-uvmcopy(pagetable_t old, pagetable_t new, pagetable_t knew, uint64 sz)
+uvmcopy(pagetable_t old, pagetable_t kold, pagetable_t new, pagetable_t knew, uint64 sz)
 {
-  pte_t *pte;
+  pte_t *pte, *kpte;
   uint64 pa, i = 0, ki = 0;
   uint flags;
-  char *mem;
 
   while (i < sz){
     if((pte = walk(old, i, 0)) == NULL)
@@ -382,28 +376,67 @@ uvmcopy(pagetable_t old, pagetable_t new, pagetable_t knew, uint64 sz)
     if((*pte & PTE_V) == 0)
       panic("uvmcopy: page not present");
     pa = PTE2PA(*pte);
+    if(*pte & PTE_W){
+      if((kpte = walk(kold, i, 0)) == NULL || (*kpte & PTE_V) == 0)
+        panic("uvmcopy: no kernel mirror");
+      *pte = (*pte & ~PTE_W) | PTE_COW;
+      *kpte = (*kpte & ~PTE_W) | PTE_COW;
+    }
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == NULL)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0) {
-      kfree(mem);
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    }
+    kref_get((void*)pa);
     i += PGSIZE;
-    if(mappages(knew, ki, PGSIZE, (uint64)mem, flags & ~PTE_U) != 0){
+    if(mappages(knew, ki, PGSIZE, pa, flags & ~PTE_U) != 0){
       goto err;
     }
     ki += PGSIZE;
   }
+  sfence_vma();   // the parent's pages are read-only now
   return 0;
 
  err:
+  sfence_vma();
   vmunmap(knew, 0, ki / PGSIZE, 0);
   vmunmap(new, 0, i / PGSIZE, 1);
   return -1;
 }
 
+// Make the copy-on-write page at va writable for its process,
+// in its page table and kernel mirror: the page itself if no one
+// else maps it any more, else a copy.
+// Returns 0, or -1 if va isn't such a page or memory ran out.
+int
+uvmcow(pagetable_t pagetable, pagetable_t kpagetable, uint64 va)
+{
+  pte_t *pte, *kpte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walk(pagetable, va, 0)) == NULL
+     || (*pte & (PTE_V | PTE_U | PTE_COW)) != (PTE_V | PTE_U | PTE_COW))
+    return -1;
+  if((kpte = walk(kpagetable, va, 0)) == NULL || (*kpte & PTE_V) == 0)
+    panic("uvmcow: no kernel mirror");
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW;
+  if(kshared((void*)pa)){
+    if((mem = kalloc()) == NULL)
+      return -1;
+    memmove(mem, (char*)pa, PGSIZE);
+    kfree((void*)pa);       // drops our mapping of it
+    pa = (uint64)mem;
+  }
+  *pte = PA2PTE(pa) | flags;
+  *kpte = PA2PTE(pa) | (flags & ~PTE_U);
+  sfence_vma();
+  return 0;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -445,10 +478,18 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 int
 copyout2(uint64 dstva, char *src, uint64 len)
 {
-  uint64 sz = myproc()->sz;
+  struct proc *p = myproc();
+  uint64 sz = p->sz;
+  pte_t *pte;
   if (dstva + len > sz || dstva >= sz) {
     return -1;
   }
+  // the kernel mirror of a copy-on-write page is read-only too
+  for (uint64 va = PGROUNDDOWN(dstva); va < dstva + len; va += PGSIZE) {
+    if ((pte = walk(p->pagetable, va, 0)) != NULL && (*pte & PTE_COW)
+        && uvmcow(p->pagetable, p->kpagetable, va) < 0)
+      return -1;
+  }
   memmove((void *)dstva, src, len);
   return 0;
 }
@@ -9,18 +9,34 @@
 struct buf {
   int valid;
   int disk;		// does disk "own" buf? 
+  int dirty;		// modified since it was last written to disk
+  int ra;		// read ahead, not yet asked for by bread()
   uint dev;
   uint sectorno;	// sector number 扇区号
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev;
-  struct buf *next;
+  uint64 lastuse;	// LRU stamp, set when refcnt drops to 0
+  struct buf *hnext;	// hash bucket chain
   uchar data[BSIZE];
 };
 
+struct iostat;
+
 void            binit(void);
 struct buf*     bread(uint, uint);
+void            breadn(uint, uint, int, struct buf**);
+void            bgetn(uint, uint, int, struct buf**);
+struct buf*     bgetw(uint, uint);
 void            brelse(struct buf*);
+void            brelsen(struct buf**, int);
 void            bwrite(struct buf*);
+void            bpin(struct buf*);
+void            bunpin(struct buf*);
+void            bstat(struct iostat*);
+void            bsync(void);
+void            bkick(void);
+void            bflushd(void);
+void            breadahead(uint, uint, uint);
+void            breadd(void);
 
 #endif
@@ -0,0 +1,22 @@
+#ifndef __DIRENT64_H
+#define __DIRENT64_H
+
+#include "types.h"
+
+#define DT_DIR  4
+#define DT_REG  8
+
+// A directory record returned by getdents64(), laid out like Linux's.
+// Records are packed one after another, each d_reclen bytes long.
+struct linux_dirent64 {
+  uint64 d_ino;       // first cluster on FAT32
+  long   d_off;       // offset of the next record in the directory
+  uint16 d_reclen;    // length of this record, a multiple of 8
+  uint8  d_type;      // DT_DIR or DT_REG
+  char   d_name[];    // null-terminated
+};
+
+#define DIRENT64_RECLEN(namelen) \
+  ((__builtin_offsetof(struct linux_dirent64, d_name) + (namelen) + 1 + 7) & ~7)
+
+#endif
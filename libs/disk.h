@@ -6,6 +6,10 @@
 void disk_init(void);
 void disk_read(struct buf *b);
 void disk_write(struct buf *b);
+void disk_read_vec(struct buf **bufs, int n);
+void disk_write_vec(struct buf **bufs, int n);
+void disk_submit(struct buf **bufs, int n, int write);
+void disk_wait(struct buf *b);
 void disk_intr(void);
 
 #endif
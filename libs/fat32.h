@@ -24,6 +24,15 @@
 #define ENTRY_CACHE_NUM     50
 
 
+// A run of clusters that are contiguous both in the file and on disk.
+struct extent {
+    uint32  lclus;          // first cluster of the run, counted from the start of the file
+    uint32  pclus;          // its cluster number on disk
+    uint32  len;            // clusters in the run
+};
+
+struct dindex;
+
 // 可以把它理解为inode
 struct dirent {
     char  filename[FAT32_MAX_FILENAME + 1];
@@ -32,6 +41,17 @@ struct dirent {
     uint32  file_size;
     uint32  cur_clus;
     uint    clus_cnt;
+    struct extent *ext;     // extent map of the cluster chain, built lazily
+    uint32  ext_max;        // room in ext[]
+    uint32  ext_cnt;        // extents in ext[]
+    uint32  ext_clus;       // clusters of the chain ext[] covers
+    uint32  clus_gen;       // bumped when the chain is freed, see ecursor_load()
+    uint32  res_clus;       // clusters reserved for the chain to grow into,
+    uint32  res_cnt;        // free on disk but taken in the bitmap
+    uint32  pend_prev;      // the chain continues after pend_prev (0: from the start)
+    uint32  pend_clus;      // with pend_cnt clusters from pend_clus, which are
+    uint32  pend_cnt;       // not in the FAT yet, see epend_flush()
+    struct dindex *dix;     // name index of a directory, built lazily
     /* for OS */
     uint8   dev;
     uint8   dirty;
@@ -39,12 +59,24 @@ struct dirent {
     int     ref;
     uint32  off;            // 在根目录中的偏移，便于写入
     struct dirent *parent;  // because FAT32 doesn't have such thing like inum, use this for cache trick
+    uint32  eid;            // tells this use of the ecache slot from earlier ones
+    uint32  parent_eid;     // parent's eid when parent was set
+    struct dirent *hnext;   // ecache hash chain
+    int     hidx;           // ecache hash bucket, -1 if not hashed
     struct dirent *next;
     struct dirent *prev;
     struct sleeplock    lock;
 };
 
+struct statfs;
+struct iostat;
+
 int             fat32_init(void);
+int             ecache_shrink(void);
+void            erehash(struct dirent *ep);
+void            fat32_sync(void);
+void            fat32_statfs(struct statfs *st);
+void            fat32_iostat(struct iostat *st);
 struct dirent*  dirlookup(struct dirent *entry, char *filename, uint *poff);
 char*           formatname(char *name);
 void            emake(struct dirent *dp, struct dirent *ep, uint off);
@@ -58,9 +90,15 @@ void            estat(struct dirent *ep, struct stat *st);
 void            elock(struct dirent *entry);
 void            eunlock(struct dirent *entry);
 int             enext(struct dirent *dp, struct dirent *ep, uint off, int *count);
+int             edents(struct dirent *dp, uint *poff, char *buf, int n);
 struct dirent*  ename(char *path);
 struct dirent*  enameparent(char *path, char *name);
+struct dirent*  enameat(struct dirent *base, char *path);
+struct dirent*  enameparentat(struct dirent *base, char *path, char *name);
 int             eread(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n);
+void            ereadahead(struct dirent *entry, uint off, uint n);
+void            ecursor_load(struct dirent *entry, uint32 clus, uint cnt, uint32 gen);
 int             ewrite(struct dirent *entry, int user_src, uint64 src, uint off, uint n);
+int             efalloc(struct dirent *entry, uint off, uint len, int keep);
 
 #endif
\ No newline at end of file
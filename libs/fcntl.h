@@ -5,3 +5,17 @@
 #define O_APPEND  0x004
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+
+//openat的dirfd, 以及Linux的打开标志
+#define AT_FDCWD    -100
+#define LO_CREAT    0x040
+#define LO_TRUNC    0x200
+#define LO_APPEND   0x400
+
+//lseek的whence
+#define SEEK_SET  0
+#define SEEK_CUR  1
+#define SEEK_END  2
+
+//fallocate的mode
+#define FALLOC_FL_KEEP_SIZE 0x01
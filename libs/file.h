@@ -9,6 +9,12 @@ struct file {
   struct pipe *pipe; // FD_PIPE
   struct dirent *ep;
   uint off;          // FD_ENTRY
+  uint ra_next;      // FD_ENTRY: offset at which a sequential read would start
+  uint ra_end;       // FD_ENTRY: read-ahead has been queued up to here
+  uint ra_win;       // FD_ENTRY: read-ahead window in bytes, 0 if not sequential
+  uint cur_clus;     // FD_ENTRY: our own position in the cluster chain,
+  uint clus_cnt;     //   kept here so that readers of the same file
+  uint clus_gen;     //   don't keep moving each other's
   short major;       // FD_DEVICE
 };
 
@@ -33,6 +39,9 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             fileseek(struct file*, int off, int whence);
+int             filefalloc(struct file*, int mode, int off, int len);
 int             dirnext(struct file *f, uint64 addr);
+int             filegetdents(struct file *f, uint64 addr, int n);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef __IOSTAT_H
+#define __IOSTAT_H
+
+#include "types.h"
+
+// Block I/O counters, read by the iostat() system call.
+struct iostat {
+  uint64 bread;       // bread() calls
+  uint64 bhit;        // lookups served by a cached buffer
+  uint64 bmiss;       // lookups that recycled a buffer
+  uint64 bwrite;      // bwrite() calls
+  uint64 bwback;      // dirty buffers written back to disk
+  uint64 dread;       // disk read requests
+  uint64 dwrite;      // disk write requests
+  uint64 ra;          // sectors read ahead
+  uint64 rahit;       // read-ahead sectors later used
+  uint64 rawaste;     // read-ahead sectors recycled unused
+  uint64 block;       // bcache lock acquisitions
+  uint64 bcontend;    // bcache lock acquisitions that had to spin
+  uint64 dirscan;     // directory entry walks (FAT32)
+  uint64 dirsread;    // sectors read by them
+};
+
+#endif
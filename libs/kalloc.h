@@ -4,6 +4,13 @@
 #include "types.h"
 
 void*           kalloc(void);
+void*           kalloc_zeroed(void);
+void*           kalloc_pages(int order);
+void            kfree_pages(void *, int order);
+void            kalloc_stat(uint64 *nblk);
+void            kref_get(void *);
+int             kshared(void *);
+int             kzero_fill(void);
 void            kfree(void *);
 void            kinit(void);
 uint64          freemem_amount(void);
@@ -0,0 +1,19 @@
+#ifndef __KTRACE_H
+#define __KTRACE_H
+
+#include "types.h"
+#include "trevent.h"
+
+extern volatile uint32 ktrace_mask;
+
+// A tracepoint. When the event is off, this is a load and a branch.
+#define ktrace(id, a0, a1) do { \
+    if (ktrace_mask & (1 << (id))) \
+      ktrace_emit((id), (uint64)(a0), (uint64)(a1)); \
+  } while (0)
+
+void            ktraceinit(void);
+void            ktrace_emit(int id, uint64 a0, uint64 a1);
+int             ktracectl(int cmd, uint64 addr, int n);
+
+#endif
@@ -64,12 +64,14 @@ struct proc {
   struct dirent *cwd;          // Current directory
   char name[16];               // Process name (debugging)
   int tmask;                    // trace mask
+  void (*kfn)(void);           // Body of a kernel thread, see kthread()
 };
 
 void            reg_info(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             kthread(char *name, void (*fn)(void));
 int             growproc(int);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
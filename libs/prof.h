@@ -0,0 +1,24 @@
+#ifndef __PROF_H
+#define __PROF_H
+
+#include "types.h"
+
+// prof() commands
+#define PROF_STOP     0   // stop sampling, returns the samples dropped
+#define PROF_START    1   // empty the rings and start sampling
+#define PROF_READ     2   // take up to n samples out of the rings
+
+#define PROF_DEPTH    8   // pcs kept per sample
+
+// One timer interrupt's worth of profile, read by prof(PROF_READ).
+struct profsample {
+  int pid;                // 0 if the hart was idle
+  uint8 hart;
+  uint8 user;             // pc[] are addresses in process name
+  uint8 depth;            // entries used in pc[]
+  uint8 pad;
+  char name[16];          // process name, "-" if idle
+  uint64 pc[PROF_DEPTH];  // interrupted pc, then return addresses
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef __SLAB_H
+#define __SLAB_H
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+
+#define SLAB_MAG      8     // objects in a per-hart magazine
+
+struct slab;
+
+// A hart's magazine: objects it can take or give back without a lock.
+struct kmem_mag {
+  int n;
+  void *obj[SLAB_MAG];
+};
+
+// A cache of objects of one size, carved out of whole pages (slabs).
+struct kmem_cache {
+  struct spinlock lock;
+  char *name;
+  uint size;                // object size, a multiple of 8
+  uint perslab;             // objects per slab
+  struct slab *partial;     // slabs with some objects free
+  struct slab *full;        // slabs with none
+  struct slab *empty;       // at most one slab with all of them free
+  uint64 nslab;
+  struct kmem_cache *next;  // on the list of all caches
+  struct kmem_mag mag[NCPU];
+};
+
+#define KMALLOC_MAX   2048  // bigger than this, use kalloc_pages()
+
+void            slabinit(void);
+void            kmem_cache_init(struct kmem_cache *, char *name, uint size);
+void*           kmem_cache_alloc(struct kmem_cache *);
+void            kmem_cache_free(struct kmem_cache *, void *);
+int             kmem_cache_reap(void);
+void*           kmalloc(uint size);
+void            kmfree(void *);
+
+#endif
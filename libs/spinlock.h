@@ -10,6 +10,10 @@ struct spinlock {
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+  // For profiling:
+  uint nacquire;     // Number of acquire() calls.
+  uint ncontend;     // Number of acquire() calls that had to spin.
 };
 
 // Initialize a spinlock 
@@ -0,0 +1,24 @@
+#ifndef __STATFS_H
+#define __STATFS_H
+
+#include "types.h"
+
+#define MSDOS_SUPER_MAGIC 0x4d44
+
+// File system statistics, laid out like Linux's struct statfs.
+struct statfs {
+  uint64 f_type;      // file system magic number
+  uint64 f_bsize;     // block (cluster) size in bytes
+  uint64 f_blocks;    // data blocks in the file system
+  uint64 f_bfree;     // free blocks
+  uint64 f_bavail;    // free blocks available to users
+  uint64 f_files;     // file nodes, 0 on FAT32
+  uint64 f_ffree;     // free file nodes, 0 on FAT32
+  uint32 f_fsid[2];
+  uint64 f_namelen;   // maximum file name length
+  uint64 f_frsize;    // fragment size
+  uint64 f_flags;
+  uint64 f_spare[4];
+};
+
+#endif
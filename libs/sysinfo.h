@@ -3,9 +3,12 @@
 
 #include "types.h"
 
+#define SI_NORDER 11  // block sizes the page allocator has, 2^0 to 2^10 pages
+
 struct sysinfo {
   uint64 freemem;   // amount of free memory (bytes)
   uint64 nproc;     // number of process
+  uint64 freeblk[SI_NORDER];  // free blocks of 2^k pages in the buddy allocator
 };
 
 
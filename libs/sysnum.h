@@ -14,6 +14,7 @@
 
 
 #define SYS_read         63
+#define SYS_lseek        62
 
 
 #define SYS_kill         6
@@ -63,6 +64,7 @@
 #define SYS_dev         25
 //---
 #define SYS_readdir     24
+#define SYS_getdents64  61
 
 
 #define SYS_getcwd      17
@@ -70,4 +72,13 @@
 
 #define SYS_rename      26
 
+#define SYS_iostat      27
+#define SYS_prof        28
+#define SYS_ktrace      29
+#define SYS_statfs      43
+#define SYS_fallocate   47
+
+#define SYS_sync        81
+#define SYS_fsync       82
+
 #endif
\ No newline at end of file
@@ -11,4 +11,9 @@ void timerinit();
 void set_next_timeout();
 void timer_tick();
 
+// prof.c, the sampling profiler run from the timer interrupt
+void profinit(void);
+void profsample(int user, uint64 pc, uint64 fp);
+int profctl(int cmd, uint64 addr, int n);
+
 #endif
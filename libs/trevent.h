@@ -0,0 +1,35 @@
+#ifndef __TREVENT_H
+#define __TREVENT_H
+
+#include "types.h"
+
+// Kernel trace events, see ktrace.c. An event is traced while bit
+// (1 << id) is set in the mask given to ktrace(KTRACE_START).
+#define TR_SYSCALL    1   // a0 = syscall number, a1 = its first argument
+#define TR_SYSRET     2   // a0 = syscall number, a1 = return value
+#define TR_SWTCHIN    3   // scheduler runs pid
+#define TR_SWTCHOUT   4   // pid gives the hart back, a0 = its state
+#define TR_DISKSUB    5   // a0 = first sector, a1 = count, negative for a write
+#define TR_DISKDONE   6   // a0 = first sector of the request
+#define TR_KALLOC     7   // a0 = page, a1 = order (2^a1 pages)
+#define TR_KFREE      8   // a0 = page, a1 = order
+#define TR_NEVENT     9
+
+#define TR_ALL        (((1 << TR_NEVENT) - 1) & ~1)
+
+// ktrace() commands
+#define KTRACE_STOP   0   // stop tracing, returns the events dropped
+#define KTRACE_START  1   // empty the rings and trace the events in mask n
+#define KTRACE_READ   2   // take up to n events out of the rings
+
+struct trevent {
+  uint64 time;            // r_time()
+  uint16 id;              // TR_*
+  uint8 hart;
+  uint8 pad;
+  int pid;                // 0 if the hart had no process
+  uint64 a0;
+  uint64 a1;
+};
+
+#endif
@@ -51,7 +51,8 @@
 
 // this many virtio descriptors.
 // must be a power of two.
-#define NUM 8
+// a request takes MAXBVEC + 2 of them at most.
+#define NUM 64
 
 struct VRingDesc {
   uint64 addr;
@@ -79,6 +80,9 @@ struct UsedArea {
 
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *b, int write);
+void            virtio_disk_rwv(struct buf **bufs, int n, int write);
+void            virtio_disk_submit(struct buf **bufs, int n, int write);
+void            virtio_disk_wait(struct buf *b);
 void            virtio_disk_intr(void);
 
 #endif
@@ -15,7 +15,8 @@ void            uvminit(pagetable_t, pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, pagetable_t, uint64, uint64);
 // int             uvmcopy(pagetable_t, pagetable_t, uint64);
-int             uvmcopy(pagetable_t, pagetable_t, pagetable_t, uint64);
+int             uvmcopy(pagetable_t, pagetable_t, pagetable_t, pagetable_t, uint64);
+int             uvmcow(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 // void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            vmunmap(pagetable_t, uint64, uint64, int);
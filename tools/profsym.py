@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Symbolize the samples written by user/prof and print folded stacks,
+one "frame;frame;...;frame count" line per distinct stack, which
+flamegraph.pl and speedscope take as they are.
+
+    prof -o prof.out usertests        (on the board)
+    python3 tools/profsym.py prof.out > prof.folded
+
+Kernel pcs are looked up in target/kernel.sym, user pcs in the
+user/<name>.sym of the process that was running. The input may be a
+console log: lines that aren't samples are skipped.
+"""
+
+import argparse
+import bisect
+import collections
+import os
+import re
+import sys
+
+SAMPLE = re.compile(r'([ku]) (\d+) (\d+) (\S+)((?: 0x[0-9a-f]+)+)\s*$')
+
+
+class Symtab:
+    def __init__(self, path):
+        syms = []
+        with open(path) as f:
+            for line in f:
+                parts = line.split()
+                if len(parts) != 2:
+                    continue
+                addr, name = parts
+                # sections, local labels and file names aren't functions
+                if name.startswith('.') or name.endswith(('.c', '.S')):
+                    continue
+                try:
+                    syms.append((int(addr, 16), name))
+                except ValueError:
+                    pass
+        syms.sort()
+        self.addrs = [a for a, _ in syms]
+        self.names = [n for _, n in syms]
+
+    def lookup(self, pc):
+        i = bisect.bisect_right(self.addrs, pc) - 1
+        return self.names[i] if i >= 0 else hex(pc)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('input', nargs='?', help='prof output (default: stdin)')
+    ap.add_argument('-k', '--kernel', default='target/kernel.sym')
+    ap.add_argument('-u', '--user', default='user',
+                    help='directory holding the user .sym files')
+    ap.add_argument('--no-idle', action='store_true',
+                    help='leave out samples of idle harts')
+    args = ap.parse_args()
+
+    ktab = Symtab(args.kernel)
+    utabs = {}
+
+    def usym(name):
+        if name not in utabs:
+            path = os.path.join(args.user, name + '.sym')
+            utabs[name] = Symtab(path) if os.path.exists(path) else None
+        return utabs[name]
+
+    stacks = collections.Counter()
+    f = open(args.input) if args.input else sys.stdin
+    for line in f:
+        m = SAMPLE.search(line)
+        if not m:
+            continue
+        mode, _, pid, name, pcs = m.groups()
+        if pid == '0' and args.no_idle:
+            continue
+        pcs = [int(x, 16) for x in pcs.split()]
+        tab = ktab if mode == 'k' else usym(name)
+        # return addresses point after the call, look up the call itself
+        frames = [tab.lookup(pc if i == 0 else pc - 1) if tab else hex(pc)
+                  for i, pc in enumerate(pcs)]
+        frames.reverse()
+        root = [name, '[kernel]'] if mode == 'k' else [name]
+        stacks[';'.join(root + frames)] += 1
+
+    for stack, n in stacks.most_common():
+        print(stack, n)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,26 @@
+#include "../libs/types.h"
+#include "../libs/stat.h"
+#include "../libs/statfs.h"
+#include "user.h"
+
+// Print the size and free space of the file system.
+// usage: df [path]
+
+int
+main(int argc, char *argv[])
+{
+  struct statfs st;
+  char *path = argc > 1 ? argv[1] : "/";
+  uint64 total, free;
+
+  if(statfs(path, &st) < 0){
+    fprintf(2, "df: cannot statfs %s\n", path);
+    exit(1);
+  }
+  total = st.f_blocks * st.f_bsize / 1024;
+  free = st.f_bfree * st.f_bsize / 1024;
+  printf("%s: %l KB total, %l KB used, %l KB free (%l%% used)\n",
+         path, total, total - free, free,
+         total ? (total - free) * 100 / total : 0);
+  exit(0);
+}
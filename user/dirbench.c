@@ -0,0 +1,94 @@
+#include "../libs/types.h"
+#include "../libs/stat.h"
+#include "user.h"
+#include "../libs/fcntl.h"
+
+// Create NFILE empty files in one directory, open each of them
+// again in random order, then remove them, printing the ticks
+// each phase takes. Without an index on the directory, every
+// lookup or create walks the entries before it, so the time per
+// file grows with the size of the directory.
+//
+// usage: dirbench [nfile]
+
+#define NFILE     5000
+
+static char *dir = "dirbench.d";
+
+static unsigned long randstate = 1;
+
+static unsigned int
+rand(void)
+{
+  randstate = randstate * 1103515245 + 12345;
+  return (randstate >> 16) & 0x7fff;
+}
+
+static void
+name(char *p, int i)
+{
+  char tmp[8];
+  int n = 0;
+
+  strcpy(p, "file");
+  p += 4;
+  do {
+    tmp[n++] = '0' + i % 10;
+    i /= 10;
+  } while(i > 0);
+  while(n > 0)
+    *p++ = tmp[--n];
+  *p = 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  char path[16];
+  int nfile, fd, i, t0, t1;
+
+  nfile = argc > 1 ? atoi(argv[1]) : NFILE;
+  if(mkdir(dir) < 0 || chdir(dir) < 0){
+    fprintf(2, "dirbench: cannot make %s\n", dir);
+    exit(1);
+  }
+
+  t0 = uptime();
+  for(i = 0; i < nfile; i++){
+    name(path, i);
+    if((fd = open(path, O_CREATE | O_RDWR)) < 0){
+      fprintf(2, "dirbench: cannot create %s\n", path);
+      exit(1);
+    }
+    close(fd);
+  }
+  t1 = uptime();
+  printf("create %d files: %d ticks\n", nfile, t1 - t0);
+
+  t0 = t1;
+  for(i = 0; i < nfile; i++){
+    name(path, rand() % nfile);
+    if((fd = open(path, O_RDONLY)) < 0){
+      fprintf(2, "dirbench: cannot open %s\n", path);
+      exit(1);
+    }
+    close(fd);
+  }
+  t1 = uptime();
+  printf("open %d files: %d ticks\n", nfile, t1 - t0);
+
+  t0 = t1;
+  for(i = 0; i < nfile; i++){
+    name(path, i);
+    if(remove(path) < 0){
+      fprintf(2, "dirbench: cannot remove %s\n", path);
+      exit(1);
+    }
+  }
+  t1 = uptime();
+  printf("remove %d files: %d ticks\n", nfile, t1 - t0);
+
+  chdir("..");
+  remove(dir);
+  exit(0);
+}
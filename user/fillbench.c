@@ -0,0 +1,87 @@
+#include "../libs/types.h"
+#include "../libs/stat.h"
+#include "user.h"
+#include "../libs/fcntl.h"
+
+// Fill the disk with 1 MB files until it is full (or until
+// the given number of MB), printing how long each group of
+// files took to write, to show whether cluster allocation slows
+// down as the disk fills up. The files are removed at the end.
+//
+// usage: fillbench [mb]
+
+#define FILEMB    1
+#define REPORT    8         // print every REPORT files
+#define BUFSZ     4096
+
+static char buf[BUFSZ];
+
+static void
+name(char *p, int i)
+{
+  char tmp[8];
+  int n = 0;
+
+  strcpy(p, "fill");
+  p += 4;
+  do {
+    tmp[n++] = '0' + i % 10;
+    i /= 10;
+  } while(i > 0);
+  while(n > 0)
+    *p++ = tmp[--n];
+  *p = 0;
+}
+
+// Write one file, return 0 once the disk is full.
+static int
+fill(int i)
+{
+  char path[16];
+  int fd, n, ok = 1;
+
+  name(path, i);
+  if((fd = open(path, O_CREATE | O_RDWR | O_TRUNC)) < 0){
+    fprintf(2, "fillbench: cannot create %s\n", path);
+    return 0;
+  }
+  for(n = 0; n < FILEMB * 1024 * 1024 / BUFSZ; n++){
+    if(write(fd, buf, BUFSZ) != BUFSZ){
+      ok = 0;
+      break;
+    }
+  }
+  close(fd);
+  return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+  char path[16];
+  int max, i, t0, t1, full;
+
+  max = argc > 1 ? atoi(argv[1]) / FILEMB : 0;
+  memset(buf, 'f', sizeof(buf));
+
+  full = 0;
+  t0 = uptime();
+  for(i = 0; !full && (max == 0 || i < max); i++){
+    full = !fill(i);
+    if((i + 1) % REPORT == 0 || full){
+      t1 = uptime();
+      printf("%d MB: %d ticks for the last %d MB\n",
+             (i + 1) * FILEMB, t1 - t0, ((i % REPORT) + 1) * FILEMB);
+      t0 = t1;
+    }
+  }
+  if(full)
+    printf("disk full after %d MB\n", (i - 1) * FILEMB);
+
+  sync();
+  while(i-- > 0){
+    name(path, i);
+    remove(path);
+  }
+  exit(0);
+}
@@ -1,14 +1,19 @@
 #include "../libs/types.h"
 #include "../libs/stat.h"
 #include "../libs/fcntl.h"
+#include "../libs/dirent64.h"
 #include "user.h"
 
+#define DENTBUF 1024
+
 static char path[512];
 
 void find(char *filename)
 {
-    int fd;
+    int fd, n, i;
     struct stat st;
+    struct linux_dirent64 *d;
+    char *buf;
     if ((fd = open(path, O_RDONLY)) < 0) {
         fprintf(2, "find: cannot open %s\n", path);
         return;
@@ -32,16 +37,28 @@ void find(char *filename)
         *++p = '/';
     }
     p++;
-    while (readdir(fd, &st)) {
-        strcpy(p, st.name);
-        if (strcmp(p, ".") == 0 || strcmp(p, "..") == 0) {
-            continue;
-        }
-        if (strcmp(p, filename) == 0) {
-            fprintf(1, "%s\n", path);
+    // each level has its own buffer, the records outlive the recursion
+    if ((buf = malloc(DENTBUF)) == 0) {
+        fprintf(2, "find: out of memory\n");
+        close(fd);
+        return;
+    }
+    while ((n = getdents64(fd, buf, DENTBUF)) > 0) {
+        for (i = 0; i < n; i += d->d_reclen) {
+            d = (struct linux_dirent64 *)(buf + i);
+            strcpy(p, d->d_name);
+            if (strcmp(p, ".") == 0 || strcmp(p, "..") == 0) {
+                continue;
+            }
+            if (strcmp(p, filename) == 0) {
+                fprintf(1, "%s\n", path);
+            }
+            if (d->d_type == DT_DIR) {
+                find(filename);
+            }
         }
-        find(filename);
     }
+    free(buf);
     close(fd);
     return;
 }
@@ -0,0 +1,79 @@
+#include "../libs/types.h"
+#include "../libs/stat.h"
+#include "../libs/sysinfo.h"
+#include "user.h"
+
+// fork/exit/wait in a loop, by 1 and then 2 processes at once, so
+// that on two harts both keep the page allocator busy: each fork
+// allocates the child's page tables, stack, trapframe and a copy of
+// its memory, and exit frees them. Prints forks per 100 ticks, and
+// checks that free memory comes back to where it started.
+// The process first grows by kb KB (64 by default), to see how fork
+// time depends on the size of the process.
+//
+// usage: forkbench [kb]
+
+#define NFORK     400       // forks per run, split among the processes
+
+static void
+worker(int n)
+{
+  int pid;
+
+  for(int i = 0; i < n; i++){
+    if((pid = fork()) < 0){
+      fprintf(2, "forkbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+  exit(0);
+}
+
+static void
+run(int np)
+{
+  int i, t0, t1;
+
+  t0 = uptime();
+  for(i = 0; i < np; i++){
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "forkbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      worker(NFORK / np);
+  }
+  for(i = 0; i < np; i++)
+    wait(0);
+  t1 = uptime();
+  if(t1 == t0)
+    t1++;
+  printf("%d procs: %d forks in %d ticks, %d forks/100 ticks\n",
+         np, NFORK, t1 - t0, NFORK * 100 / (t1 - t0));
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sysinfo si0, si1;
+  int grow = (argc > 1 ? atoi(argv[1]) : 64) * 1024;
+
+  if(sbrk(grow) == (char *)-1){
+    fprintf(2, "forkbench: sbrk failed\n");
+    exit(1);
+  }
+  memset(sbrk(0) - grow, 1, grow);
+  printf("forkbench: %d KB process\n", grow / 1024);
+  sysinfo(&si0);
+  run(1);
+  run(2);
+  sysinfo(&si1);
+  if(si1.freemem != si0.freemem)
+    printf("forkbench: free memory %l before, %l after\n",
+           si0.freemem, si1.freemem);
+  exit(0);
+}
@@ -0,0 +1,31 @@
+#include "../libs/types.h"
+#include "../libs/stat.h"
+#include "../libs/sysinfo.h"
+#include "user.h"
+
+// Print free memory, and how the page allocator's free blocks are
+// split by size: many small blocks and no big ones means memory is
+// fragmented, and kalloc_pages() of a high order will fail.
+// usage: free
+
+int
+main(int argc, char *argv[])
+{
+  struct sysinfo info;
+  int k, big = -1;
+
+  if(sysinfo(&info) < 0){
+    fprintf(2, "free: sysinfo failed\n");
+    exit(1);
+  }
+  printf("%l KB free, %l processes\n", info.freemem / 1024, info.nproc);
+  for(k = 0; k < SI_NORDER; k++){
+    if(info.freeblk[k] == 0)
+      continue;
+    printf("%d KB blocks: %l\n", 4 << k, info.freeblk[k]);
+    big = k;
+  }
+  if(big >= 0)
+    printf("largest free block: %d KB\n", 4 << big);
+  exit(0);
+}
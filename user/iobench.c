@@ -0,0 +1,106 @@
+#include "../libs/types.h"
+#include "../libs/stat.h"
+#include "user.h"
+#include "../libs/fcntl.h"
+
+// Random 512-byte reads from a file much larger than the buffer
+// cache, by 1, 4 and 8 processes at once, i.e. at disk queue depth
+// 1, 4 and 8. Prints how many reads complete per 100 ticks.
+
+#define FILESECS  2048      // 1 MB, 32 times the buffer cache
+#define NOPS      2048      // reads per run, split among the processes
+
+static char *path = "iobench.dat";
+static char buf[512];
+
+static unsigned long randstate;
+
+static unsigned int
+rand(void)
+{
+  randstate = randstate * 1103515245 + 12345;
+  return (randstate >> 16) & 0x7fff;
+}
+
+static void
+mkfile(void)
+{
+  struct stat st;
+  int fd, i;
+
+  if((fd = open(path, O_RDONLY)) >= 0){
+    fstat(fd, &st);
+    close(fd);
+    if(st.size >= FILESECS * 512)
+      return;
+  }
+  printf("iobench: creating %s\n", path);
+  if((fd = open(path, O_CREATE | O_RDWR | O_TRUNC)) < 0){
+    fprintf(2, "iobench: cannot create %s\n", path);
+    exit(1);
+  }
+  for(i = 0; i < FILESECS; i++){
+    memset(buf, i, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      fprintf(2, "iobench: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+  sync();
+}
+
+static void
+reader(int nops)
+{
+  int fd, i;
+
+  randstate = getpid();
+  if((fd = open(path, O_RDONLY)) < 0){
+    fprintf(2, "iobench: cannot open %s\n", path);
+    exit(1);
+  }
+  for(i = 0; i < nops; i++){
+    if(lseek(fd, (rand() % FILESECS) * 512, SEEK_SET) < 0 ||
+       read(fd, buf, sizeof(buf)) != sizeof(buf)){
+      fprintf(2, "iobench: read failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+  exit(0);
+}
+
+static void
+run(int qd)
+{
+  int i, t0, t1;
+
+  t0 = uptime();
+  for(i = 0; i < qd; i++){
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "iobench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      reader(NOPS / qd);
+  }
+  for(i = 0; i < qd; i++)
+    wait(0);
+  t1 = uptime();
+  if(t1 == t0)
+    t1++;
+  printf("qd %d: %d reads in %d ticks, %d reads/100 ticks\n",
+         qd, NOPS, t1 - t0, NOPS * 100 / (t1 - t0));
+}
+
+int
+main(int argc, char *argv[])
+{
+  mkfile();
+  run(1);
+  run(4);
+  run(8);
+  exit(0);
+}
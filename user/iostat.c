@@ -0,0 +1,75 @@
+#include "../libs/types.h"
+#include "../libs/stat.h"
+#include "../libs/iostat.h"
+#include "user.h"
+
+// Print block I/O counters. With a command, print how much
+// they changed while the command ran.
+
+static void
+show(struct iostat *st)
+{
+  printf("bread:    %l\n", st->bread);
+  printf("hit:      %l\n", st->bhit);
+  printf("miss:     %l\n", st->bmiss);
+  if(st->bhit + st->bmiss)
+    printf("hit rate: %l%%\n", st->bhit * 100 / (st->bhit + st->bmiss));
+  printf("bwrite:   %l\n", st->bwrite);
+  printf("wback:    %l\n", st->bwback);
+  printf("disk rd:  %l\n", st->dread);
+  printf("disk wr:  %l\n", st->dwrite);
+  printf("ra:       %l\n", st->ra);
+  printf("ra hit:   %l\n", st->rahit);
+  printf("ra waste: %l\n", st->rawaste);
+  printf("lock:     %l\n", st->block);
+  printf("contend:  %l\n", st->bcontend);
+  printf("dir scan: %l\n", st->dirscan);
+  printf("dir rd:   %l\n", st->dirsread);
+  if(st->dirscan)
+    printf("rd/scan:  %l\n", st->dirsread / st->dirscan);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct iostat st0, st1;
+  int pid;
+
+  if(iostat(&st0) < 0){
+    fprintf(2, "iostat: failed\n");
+    exit(1);
+  }
+  if(argc < 2){
+    show(&st0);
+    exit(0);
+  }
+
+  if((pid = fork()) < 0){
+    fprintf(2, "iostat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "iostat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+
+  iostat(&st1);
+  st1.bread -= st0.bread;
+  st1.bhit -= st0.bhit;
+  st1.bmiss -= st0.bmiss;
+  st1.bwrite -= st0.bwrite;
+  st1.bwback -= st0.bwback;
+  st1.dread -= st0.dread;
+  st1.dwrite -= st0.dwrite;
+  st1.ra -= st0.ra;
+  st1.rahit -= st0.rahit;
+  st1.rawaste -= st0.rawaste;
+  st1.block -= st0.block;
+  st1.bcontend -= st0.bcontend;
+  st1.dirscan -= st0.dirscan;
+  st1.dirsread -= st0.dirsread;
+  show(&st1);
+  exit(0);
+}
@@ -1,7 +1,16 @@
 #include "../libs/types.h"
 #include "../libs/stat.h"
+#include "../libs/fcntl.h"
+#include "../libs/dirent64.h"
 #include "user.h"
 
+// usage: ls [-l] [path...]
+// Names and types come from getdents64(), many files per call.
+// Sizes take a stat of each file, so they are only shown with -l.
+
+static int lflag;
+static char dbuf[4096];
+
 char*
 fmtname(char *name)
 {
@@ -17,15 +26,40 @@ fmtname(char *name)
   return buf;
 }
 
+static char *types[] = {
+  [T_DIR]   "DIR ",
+  [T_FILE]  "FILE",
+};
+
+// Print the size of name in directory path.
+static void
+lsize(char *path, char *name)
+{
+  char full[512], *p;
+  struct stat st;
+  int fd = -1;
+
+  if(strlen(path) + 1 + strlen(name) + 1 <= sizeof(full)){
+    strcpy(full, path);
+    p = full + strlen(full);
+    *p++ = '/';
+    strcpy(p, name);
+    fd = open(full, O_RDONLY);
+  }
+  if(fd >= 0 && fstat(fd, &st) >= 0)
+    printf("\t%d\n", st.size);
+  else
+    printf("\t?\n");
+  if(fd >= 0)
+    close(fd);
+}
+
 void
 ls(char *path)
 {
-  int fd;
+  int fd, n, i;
   struct stat st;
-  char *types[] = {
-    [T_DIR]   "DIR ",
-    [T_FILE]  "FILE",
-  };
+  struct linux_dirent64 *d;
 
   if((fd = open(path, 0)) < 0){
     fprintf(2, "ls: cannot open %s\n", path);
@@ -39,8 +73,15 @@ ls(char *path)
   }
 
   if (st.type == T_DIR){
-    while(readdir(fd, &st) == 1){
-      printf("%s %s\t%d\n", fmtname(st.name), types[st.type], st.size);
+    while((n = getdents64(fd, dbuf, sizeof(dbuf))) > 0){
+      for(i = 0; i < n; i += d->d_reclen){
+        d = (struct linux_dirent64 *)(dbuf + i);
+        printf("%s %s", fmtname(d->d_name), types[d->d_type == DT_DIR ? T_DIR : T_FILE]);
+        if(lflag)
+          lsize(path, d->d_name);
+        else
+          printf("\n");
+      }
     }
   } else {
     printf("%s %s\t%l\n", fmtname(st.name), types[st.type], st.size);
@@ -51,13 +92,17 @@ ls(char *path)
 int
 main(int argc, char *argv[])
 {
-  int i;
+  int i = 1;
 
-  if(argc < 2){
+  if(argc > 1 && strcmp(argv[1], "-l") == 0){
+    lflag = 1;
+    i++;
+  }
+  if(i >= argc){
     ls(".");
     exit(0);
   }
-  for(i=1; i<argc; i++)
+  for(; i<argc; i++)
     ls(argv[i]);
   exit(0);
 }
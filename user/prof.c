@@ -0,0 +1,117 @@
+#include "../libs/types.h"
+#include "../libs/stat.h"
+#include "../libs/prof.h"
+#include "user.h"
+#include "../libs/fcntl.h"
+
+// Run a command with the sampling profiler on, and write out every
+// sample taken meanwhile, on any hart and by any process, one per line:
+//
+//   k|u hart pid name pc ra ra ...
+//
+// tools/profsym.py turns these into folded stacks for a flame graph.
+//
+// usage: prof [-o file] command [args...]
+
+#define NBUF        32      // samples per prof(PROF_READ)
+#define DRAINTICKS  20      // drain this often while the command runs
+
+static struct profsample sbuf[NBUF];
+static char line[32 + sizeof(sbuf[0].name) + PROF_DEPTH * 19];
+static char digits[] = "0123456789abcdef";
+static int out = 1;
+
+static char *
+putnum(char *p, uint64 x, int base)
+{
+  char tmp[20];
+  int n = 0;
+
+  do {
+    tmp[n++] = digits[x % base];
+    x /= base;
+  } while(x > 0);
+  if(base == 16){
+    *p++ = '0';
+    *p++ = 'x';
+  }
+  while(n > 0)
+    *p++ = tmp[--n];
+  return p;
+}
+
+// Write out the samples waiting in the kernel.
+static void
+drain(void)
+{
+  struct profsample *s;
+  char *p;
+  int n;
+
+  while((n = prof(PROF_READ, sbuf, NBUF)) > 0){
+    for(s = sbuf; s < sbuf + n; s++){
+      p = line;
+      *p++ = s->user ? 'u' : 'k';
+      *p++ = ' ';
+      p = putnum(p, s->hart, 10);
+      *p++ = ' ';
+      p = putnum(p, s->pid, 10);
+      *p++ = ' ';
+      strcpy(p, s->name[0] ? s->name : "-");
+      p += strlen(p);
+      for(int i = 0; i < s->depth && i < PROF_DEPTH; i++){
+        *p++ = ' ';
+        p = putnum(p, s->pc[i], 16);
+      }
+      *p++ = '\n';
+      write(out, line, p - line);
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i = 1, pid, drainer, w, drop;
+
+  if(argc > 2 && strcmp(argv[1], "-o") == 0){
+    if((out = open(argv[2], O_CREATE | O_WRONLY | O_TRUNC)) < 0){
+      fprintf(2, "prof: cannot create %s\n", argv[2]);
+      exit(1);
+    }
+    i = 3;
+  }
+  if(i >= argc){
+    fprintf(2, "usage: prof [-o file] command [args...]\n");
+    exit(1);
+  }
+
+  if(prof(PROF_START, 0, 0) < 0){
+    fprintf(2, "prof: cannot start the profiler\n");
+    exit(1);
+  }
+  if((pid = fork()) == 0){
+    exec(argv[i], argv + i);
+    fprintf(2, "prof: exec %s failed\n", argv[i]);
+    exit(1);
+  }
+  // the rings only hold about a second of samples, so empty them
+  // while the command runs
+  if((drainer = fork()) == 0){
+    for(;;){
+      sleep(DRAINTICKS);
+      drain();
+    }
+  }
+  while((w = wait(0)) >= 0 && w != pid)
+    ;
+  if(drainer > 0){
+    kill(drainer);
+    wait(0);
+  }
+  drop = prof(PROF_STOP, 0, 0);
+  drain();
+  if(drop > 0)
+    fprintf(2, "prof: %d samples dropped\n", drop);
+  exit(0);
+}
@@ -0,0 +1,81 @@
+#include "../libs/types.h"
+#include "../libs/stat.h"
+#include "../libs/iostat.h"
+#include "user.h"
+#include "../libs/fcntl.h"
+
+// Random 4 KB reads across a 4 MB file. Prints the time they take
+// and how many buffer cache lookups (mostly FAT lookups to find
+// the cluster of each offset) they cost.
+
+#define FILESZ    (4 * 1024 * 1024)
+#define BLKSZ     4096
+#define NREAD     1000
+
+static char *path = "randread.dat";
+static char buf[BLKSZ];
+
+static unsigned long randstate = 1;
+
+static unsigned int
+rand(void)
+{
+  randstate = randstate * 1103515245 + 12345;
+  return (randstate >> 16) & 0x7fff;
+}
+
+static void
+mkfile(void)
+{
+  struct stat st;
+  int fd, i;
+
+  if((fd = open(path, O_RDONLY)) >= 0){
+    fstat(fd, &st);
+    close(fd);
+    if(st.size >= FILESZ)
+      return;
+  }
+  printf("randread: creating %s\n", path);
+  if((fd = open(path, O_CREATE | O_RDWR | O_TRUNC)) < 0){
+    fprintf(2, "randread: cannot create %s\n", path);
+    exit(1);
+  }
+  for(i = 0; i < FILESZ / BLKSZ; i++){
+    memset(buf, i, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      fprintf(2, "randread: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct iostat st0, st1;
+  int fd, i, t0, t1;
+
+  mkfile();
+  if((fd = open(path, O_RDONLY)) < 0){
+    fprintf(2, "randread: cannot open %s\n", path);
+    exit(1);
+  }
+  iostat(&st0);
+  t0 = uptime();
+  for(i = 0; i < NREAD; i++){
+    if(lseek(fd, (rand() % (FILESZ / BLKSZ)) * BLKSZ, SEEK_SET) < 0 ||
+       read(fd, buf, sizeof(buf)) != sizeof(buf)){
+      fprintf(2, "randread: read failed\n");
+      exit(1);
+    }
+  }
+  t1 = uptime();
+  iostat(&st1);
+  close(fd);
+
+  printf("%d random %d-byte reads: %d ticks, %l cache lookups, %l disk reads\n",
+         NREAD, BLKSZ, t1 - t0, st1.bread - st0.bread, st1.dread - st0.dread);
+  exit(0);
+}
@@ -0,0 +1,79 @@
+#include "../libs/types.h"
+#include "../libs/stat.h"
+#include "../libs/iostat.h"
+#include "user.h"
+#include "../libs/fcntl.h"
+
+// Write NFILE files of FILEKB each, sync, then time removing
+// them. Prints the ticks and how many buffer writes (mostly FAT
+// sectors) and disk writes the removal took.
+//
+// usage: rmbench [nfile [kb]]
+
+#define NFILE     16
+#define FILEKB    512
+#define BUFSZ     4096
+
+static char buf[BUFSZ];
+
+static void
+name(char *p, int i)
+{
+  char tmp[8];
+  int n = 0;
+
+  strcpy(p, "rm");
+  p += 2;
+  do {
+    tmp[n++] = '0' + i % 10;
+    i /= 10;
+  } while(i > 0);
+  while(n > 0)
+    *p++ = tmp[--n];
+  *p = 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct iostat st0, st1;
+  char path[16];
+  int nfile, kb, fd, i, n, t0, t1;
+
+  nfile = argc > 1 ? atoi(argv[1]) : NFILE;
+  kb = argc > 2 ? atoi(argv[2]) : FILEKB;
+  memset(buf, 'r', sizeof(buf));
+
+  for(i = 0; i < nfile; i++){
+    name(path, i);
+    if((fd = open(path, O_CREATE | O_RDWR | O_TRUNC)) < 0){
+      fprintf(2, "rmbench: cannot create %s\n", path);
+      exit(1);
+    }
+    for(n = 0; n < kb * 1024 / BUFSZ; n++){
+      if(write(fd, buf, BUFSZ) != BUFSZ){
+        fprintf(2, "rmbench: write failed\n");
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+  sync();
+
+  iostat(&st0);
+  t0 = uptime();
+  for(i = 0; i < nfile; i++){
+    name(path, i);
+    if(remove(path) < 0){
+      fprintf(2, "rmbench: cannot remove %s\n", path);
+      exit(1);
+    }
+  }
+  sync();
+  t1 = uptime();
+  iostat(&st1);
+
+  printf("remove %d files of %d KB: %d ticks, %l bwrite, %l disk writes\n",
+         nfile, kb, t1 - t0, st1.bwrite - st0.bwrite, st1.dwrite - st0.dwrite);
+  exit(0);
+}
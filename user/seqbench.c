@@ -0,0 +1,98 @@
+#include "../libs/types.h"
+#include "../libs/stat.h"
+#include "../libs/iostat.h"
+#include "user.h"
+#include "../libs/fcntl.h"
+
+// NWRITER processes append to their own files at the same time,
+// then each file is read back sequentially. Prints the ticks and
+// disk read requests the reads took: the more the files got
+// interleaved on disk, the more (and smaller) requests.
+// With -p, each writer first reserves its whole file with fallocate().
+//
+// usage: seqbench [-p]
+
+#define NWRITER   4
+#define FILESZ    (1024 * 1024)
+#define BUFSZ     4096
+
+static char buf[BUFSZ];
+
+static void
+name(char *p, int i)
+{
+  strcpy(p, "seq0");
+  p[3] += i;
+}
+
+static void
+writer(int i, int prealloc)
+{
+  char path[8];
+  int fd, n;
+
+  name(path, i);
+  if((fd = open(path, O_CREATE | O_RDWR | O_TRUNC)) < 0){
+    fprintf(2, "seqbench: cannot create %s\n", path);
+    exit(1);
+  }
+  if(prealloc && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, FILESZ) < 0){
+    fprintf(2, "seqbench: fallocate failed\n");
+    exit(1);
+  }
+  memset(buf, 'a' + i, sizeof(buf));
+  for(n = 0; n < FILESZ / BUFSZ; n++){
+    if(write(fd, buf, BUFSZ) != BUFSZ){
+      fprintf(2, "seqbench: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct iostat st0, st1;
+  char path[8];
+  int prealloc, fd, i, t0, t1;
+
+  prealloc = argc > 1 && strcmp(argv[1], "-p") == 0;
+  for(i = 0; i < NWRITER; i++){
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "seqbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      writer(i, prealloc);
+  }
+  for(i = 0; i < NWRITER; i++)
+    wait(0);
+  sync();
+
+  iostat(&st0);
+  t0 = uptime();
+  for(i = 0; i < NWRITER; i++){
+    name(path, i);
+    if((fd = open(path, O_RDONLY)) < 0){
+      fprintf(2, "seqbench: cannot open %s\n", path);
+      exit(1);
+    }
+    while(read(fd, buf, BUFSZ) == BUFSZ)
+      ;
+    close(fd);
+  }
+  t1 = uptime();
+  iostat(&st1);
+  printf("%s: read %d files of %d KB: %d ticks, %l disk reads\n",
+         prealloc ? "fallocate" : "append", NWRITER, FILESZ / 1024,
+         t1 - t0, st1.dread - st0.dread);
+
+  for(i = 0; i < NWRITER; i++){
+    name(path, i);
+    remove(path);
+  }
+  exit(0);
+}
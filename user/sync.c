@@ -0,0 +1,13 @@
+#include "../libs/types.h"
+#include "../libs/stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  if(sync() < 0){
+    fprintf(2, "sync: failed\n");
+    exit(1);
+  }
+  exit(0);
+}
@@ -0,0 +1,163 @@
+#include "../libs/types.h"
+#include "../libs/stat.h"
+#include "../libs/trevent.h"
+#include "user.h"
+#include "../libs/fcntl.h"
+
+// Run a command with kernel event tracing on, and print the events
+// recorded meanwhile, on any hart and by any process, one per line:
+//
+//   time hart pid event a0 a1
+//
+// time is in timer ticks (r_time()). The events are picked with -e:
+//   s  syscall entry and return
+//   w  context switches
+//   d  disk requests
+//   m  page allocation
+// and default to all of them.
+//
+// usage: trace [-e swdm] [-o file] command [args...]
+
+#define NBUF        32      // events per ktrace(KTRACE_READ)
+#define DRAINTICKS  5       // drain this often while the command runs
+
+static struct trevent ebuf[NBUF];
+static char lines[NBUF * 96];
+static char digits[] = "0123456789abcdef";
+static int out = 1;
+
+static char *names[TR_NEVENT] = {
+  [TR_SYSCALL]  "syscall",
+  [TR_SYSRET]   "sysret",
+  [TR_SWTCHIN]  "swtchin",
+  [TR_SWTCHOUT] "swtchout",
+  [TR_DISKSUB]  "disksub",
+  [TR_DISKDONE] "diskdone",
+  [TR_KALLOC]   "kalloc",
+  [TR_KFREE]    "kfree",
+};
+
+static char *
+putnum(char *p, uint64 x, int base)
+{
+  char tmp[20];
+  int n = 0;
+
+  do {
+    tmp[n++] = digits[x % base];
+    x /= base;
+  } while(x > 0);
+  if(base == 16){
+    *p++ = '0';
+    *p++ = 'x';
+  }
+  while(n > 0)
+    *p++ = tmp[--n];
+  return p;
+}
+
+// Write out the events waiting in the kernel, a batch per write(),
+// so that the syscalls this makes add few events of their own.
+static void
+drain(void)
+{
+  struct trevent *e;
+  char *p;
+  int n;
+
+  while((n = ktrace(KTRACE_READ, ebuf, NBUF)) > 0){
+    p = lines;
+    for(e = ebuf; e < ebuf + n; e++){
+      p = putnum(p, e->time, 10);
+      *p++ = ' ';
+      p = putnum(p, e->hart, 10);
+      *p++ = ' ';
+      p = putnum(p, e->pid, 10);
+      *p++ = ' ';
+      strcpy(p, e->id < TR_NEVENT && names[e->id] ? names[e->id] : "?");
+      p += strlen(p);
+      *p++ = ' ';
+      p = putnum(p, e->a0, e->id == TR_KALLOC || e->id == TR_KFREE ? 16 : 10);
+      *p++ = ' ';
+      if((long)e->a1 < 0){
+        *p++ = '-';
+        p = putnum(p, -e->a1, 10);
+      } else
+        p = putnum(p, e->a1, 10);
+      *p++ = '\n';
+    }
+    write(out, lines, p - lines);
+  }
+}
+
+static int
+mask(char *s)
+{
+  int m = 0;
+
+  for(; *s; s++){
+    switch(*s){
+    case 's': m |= (1 << TR_SYSCALL) | (1 << TR_SYSRET); break;
+    case 'w': m |= (1 << TR_SWTCHIN) | (1 << TR_SWTCHOUT); break;
+    case 'd': m |= (1 << TR_DISKSUB) | (1 << TR_DISKDONE); break;
+    case 'm': m |= (1 << TR_KALLOC) | (1 << TR_KFREE); break;
+    default: return -1;
+    }
+  }
+  return m;
+}
+
+static void
+usage(void)
+{
+  fprintf(2, "usage: trace [-e swdm] [-o file] command [args...]\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, pid, drainer, w, drop, m = TR_ALL;
+
+  for(i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2){
+    if(strcmp(argv[i], "-e") == 0){
+      if((m = mask(argv[i + 1])) <= 0)
+        usage();
+    } else if(strcmp(argv[i], "-o") == 0){
+      if((out = open(argv[i + 1], O_CREATE | O_WRONLY | O_TRUNC)) < 0){
+        fprintf(2, "trace: cannot create %s\n", argv[i + 1]);
+        exit(1);
+      }
+    } else
+      usage();
+  }
+  if(i >= argc)
+    usage();
+
+  if(ktrace(KTRACE_START, 0, m) < 0){
+    fprintf(2, "trace: cannot start tracing\n");
+    exit(1);
+  }
+  if((pid = fork()) == 0){
+    exec(argv[i], argv + i);
+    fprintf(2, "trace: exec %s failed\n", argv[i]);
+    exit(1);
+  }
+  if((drainer = fork()) == 0){
+    for(;;){
+      sleep(DRAINTICKS);
+      drain();
+    }
+  }
+  while((w = wait(0)) >= 0 && w != pid)
+    ;
+  if(drainer > 0){
+    kill(drainer);
+    wait(0);
+  }
+  drop = ktrace(KTRACE_STOP, 0, 0);
+  drain();
+  if(drop > 0)
+    fprintf(2, "trace: %d events dropped\n", drop);
+  exit(0);
+}
@@ -5,6 +5,8 @@
 struct stat;
 struct rtcdate;
 struct sysinfo;
+struct iostat;
+struct statfs;
 
 // system calls
 int fork(void);
@@ -33,6 +35,15 @@ int remove(char *filename);
 int trace(int mask);
 int sysinfo(struct sysinfo *);
 int rename(char *old, char *new);
+int iostat(struct iostat *);
+int sync(void);
+int fsync(int fd);
+int lseek(int fd, int offset, int whence);
+int statfs(const char *path, struct statfs *);
+int getdents64(int fd, void *buf, int len);
+int fallocate(int fd, int mode, int offset, int len);
+int prof(int cmd, void *buf, int n);
+int ktrace(int cmd, void *buf, int n);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -6,6 +6,8 @@
 #include "../libs/syscall.h"
 #include "../libs/memlayout.h"
 #include "../libs/riscv.h"
+#include "../libs/statfs.h"
+#include "../libs/dirent64.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -2535,6 +2537,670 @@ execout(char *s)
   exit(0);
 }
 
+// fork shares user pages copy-on-write. a write on either side
+// must leave the other one's view alone, whichever writes first.
+#define COWPAGES 8
+
+void
+cowfork(char *s)
+{
+  int fds[2], pid, xstatus;
+  char c, *p;
+
+  p = sbrk(COWPAGES * PGSIZE);
+  if(p == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < COWPAGES * PGSIZE; i++)
+    p[i] = i % 251;
+
+  // the child writes first.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(int i = 0; i < COWPAGES * PGSIZE; i++){
+      if(p[i] != (char)(i % 251)){
+        printf("%s: child sees wrong data before writing\n", s);
+        exit(1);
+      }
+      p[i] = 7;
+    }
+    for(int i = 0; i < COWPAGES * PGSIZE; i++){
+      if(p[i] != 7){
+        printf("%s: child lost its own write\n", s);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+  for(int i = 0; i < COWPAGES * PGSIZE; i++){
+    if(p[i] != (char)(i % 251)){
+      printf("%s: child's write reached the parent\n", s);
+      exit(1);
+    }
+  }
+
+  // the parent writes first, while the child still shares the pages.
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[1]);
+    if(read(fds[0], &c, 1) != 1){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    for(int i = 0; i < COWPAGES * PGSIZE; i++){
+      if(p[i] != (char)(i % 251)){
+        printf("%s: parent's write reached the child\n", s);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[0]);
+  for(int i = 0; i < COWPAGES * PGSIZE; i++)
+    p[i] = 9;
+  write(fds[1], "x", 1);
+  close(fds[1]);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+  for(int i = 0; i < COWPAGES * PGSIZE; i++){
+    if(p[i] != 9){
+      printf("%s: parent lost its own write\n", s);
+      exit(1);
+    }
+  }
+
+  // several children share one page, each writes it in turn.
+  for(int k = 0; k < 4; k++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      if(p[0] != 9){
+        printf("%s: an earlier child's write is visible\n", s);
+        exit(1);
+      }
+      p[0] = 'a' + k;
+      sleep(1);
+      exit(p[0] == 'a' + k ? 0 : 1);
+    }
+  }
+  for(int k = 0; k < 4; k++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: children overwrote each other\n", s);
+      exit(1);
+    }
+  }
+  if(p[0] != 9){
+    printf("%s: a child's write reached the parent\n", s);
+    exit(1);
+  }
+}
+
+// the kernel writing into a copy-on-write page, for read()
+// from a pipe or a file, must copy the page first too.
+void
+cowcopyout(char *s)
+{
+  enum { N = 100 };
+  int fds[2], fd, pid, xstatus;
+  char *p;
+
+  p = sbrk(3 * PGSIZE);
+  if(p == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  memset(p, 'a', 3 * PGSIZE);
+
+  // the child read()s from a pipe into the shared page.
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[1]);
+    if(read(fds[0], p, N) != N){
+      printf("%s: read from pipe failed\n", s);
+      exit(1);
+    }
+    for(int i = 0; i < 3 * PGSIZE; i++){
+      if(p[i] != (i < N ? 'b' : 'a')){
+        printf("%s: child's page is wrong after read\n", s);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[0]);
+  memset(buf, 'b', N);
+  if(write(fds[1], buf, N) != N){
+    printf("%s: write to pipe failed\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+  for(int i = 0; i < 3 * PGSIZE; i++){
+    if(p[i] != 'a'){
+      printf("%s: child's read() reached the parent\n", s);
+      exit(1);
+    }
+  }
+
+  // the parent read()s a file across two shared pages,
+  // while the child still holds them.
+  remove("cowfile");
+  fd = open("cowfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create cowfile failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'c', sizeof(buf));
+  for(int n = 0; n < PGSIZE; n += sizeof(buf)){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write cowfile failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    char c;
+    close(fds[1]);
+    read(fds[0], &c, 1);
+    for(int i = 0; i < 3 * PGSIZE; i++){
+      if(p[i] != 'a'){
+        printf("%s: parent's read() reached the child\n", s);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[0]);
+  fd = open("cowfile", O_RDONLY);
+  if(fd < 0 || read(fd, p + PGSIZE / 2, PGSIZE) != PGSIZE){
+    printf("%s: read cowfile failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  remove("cowfile");
+  write(fds[1], "x", 1);
+  close(fds[1]);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+  for(int i = 0; i < 3 * PGSIZE; i++){
+    int in = i >= PGSIZE / 2 && i < PGSIZE / 2 + PGSIZE;
+    if(p[i] != (in ? 'c' : 'a')){
+      printf("%s: parent's page is wrong after read\n", s);
+      exit(1);
+    }
+  }
+}
+
+// a child that gives back shared pages, with sbrk() or exec(),
+// must only drop its references: the parent keeps its data, and
+// no page is freed while still mapped or leaked afterwards
+// (see countfree() at the end of the run).
+void
+cowfree(char *s)
+{
+  int pid, xstatus;
+  char *p, *q;
+
+  p = sbrk(COWPAGES * PGSIZE);
+  if(p == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  memset(p, 'p', COWPAGES * PGSIZE);
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sbrk(-COWPAGES * PGSIZE);
+    // grow again: fresh zeroed pages, not the parent's
+    q = sbrk(COWPAGES * PGSIZE);
+    if(q != p){
+      printf("%s: sbrk moved\n", s);
+      exit(1);
+    }
+    for(int i = 0; i < COWPAGES * PGSIZE; i++){
+      if(q[i] != 0){
+        printf("%s: regrown page not zeroed\n", s);
+        exit(1);
+      }
+    }
+    memset(q, 'q', COWPAGES * PGSIZE);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+  for(int i = 0; i < COWPAGES * PGSIZE; i++){
+    if(p[i] != 'p'){
+      printf("%s: child's sbrk() changed the parent\n", s);
+      exit(1);
+    }
+  }
+  // the parent is the only owner now and can write.
+  memset(p, 'r', COWPAGES * PGSIZE);
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    char *args[] = { "echo", "x", 0 };
+    close(1);
+    exec("echo", args);
+    printf("%s: exec echo failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+  for(int i = 0; i < COWPAGES * PGSIZE; i++){
+    if(p[i] != 'r'){
+      printf("%s: child's exec() changed the parent\n", s);
+      exit(1);
+    }
+  }
+  memset(p, 's', COWPAGES * PGSIZE);
+}
+
+// fsync() writes a file's blocks and size back, and takes
+// nothing but files.
+void
+fsynctest(char *s)
+{
+  enum { N = 3 * BSIZE + 100 };
+  int fd, fds[2];
+  struct stat st;
+
+  remove("fsyncfile");
+  fd = open("fsyncfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create fsyncfile failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'f', N);
+  if(write(fd, buf, N) != N){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if(fsync(fd) != 0){
+    printf("%s: fsync failed\n", s);
+    exit(1);
+  }
+  // still usable after the sync
+  if(write(fd, "g", 1) != 1 || fsync(fd) != 0){
+    printf("%s: write or fsync after fsync failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("fsyncfile", O_RDONLY);
+  if(fd < 0 || fstat(fd, &st) < 0 || st.size != N + 1){
+    printf("%s: wrong size after fsync\n", s);
+    exit(1);
+  }
+  memset(buf, 0, N + 1);
+  if(read(fd, buf, N + 1) != N + 1 || buf[0] != 'f' || buf[N - 1] != 'f' || buf[N] != 'g'){
+    printf("%s: wrong data after fsync\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(fsync(fd) != -1){
+    printf("%s: fsync of a closed fd succeeded\n", s);
+    exit(1);
+  }
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(fsync(fds[0]) != -1 || fsync(fds[1]) != -1){
+    printf("%s: fsync of a pipe succeeded\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  remove("fsyncfile");
+}
+
+// lseek() moves the offset within [0, size] of a file only.
+void
+lseektest(char *s)
+{
+  int fd, fds[2];
+  char b[8];
+
+  remove("lseekfile");
+  fd = open("lseekfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create lseekfile failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "abcdefghij", 10) != 10){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if(lseek(fd, 0, SEEK_CUR) != 10){
+    printf("%s: SEEK_CUR after write is wrong\n", s);
+    exit(1);
+  }
+  if(lseek(fd, 2, SEEK_SET) != 2 || read(fd, b, 3) != 3 || memcmp(b, "cde", 3) != 0){
+    printf("%s: read after SEEK_SET is wrong\n", s);
+    exit(1);
+  }
+  if(lseek(fd, 1, SEEK_CUR) != 6 || read(fd, b, 1) != 1 || b[0] != 'g'){
+    printf("%s: read after SEEK_CUR is wrong\n", s);
+    exit(1);
+  }
+  if(lseek(fd, -2, SEEK_END) != 8 || read(fd, b, 8) != 2 || memcmp(b, "ij", 2) != 0){
+    printf("%s: read after SEEK_END is wrong\n", s);
+    exit(1);
+  }
+  // a write where the offset was moved to overwrites in place
+  if(lseek(fd, 4, SEEK_SET) != 4 || write(fd, "XY", 2) != 2){
+    printf("%s: write after lseek failed\n", s);
+    exit(1);
+  }
+  if(lseek(fd, 0, SEEK_SET) != 0 || read(fd, buf, sizeof(buf)) != 10
+     || memcmp(buf, "abcdXYghij", 10) != 0){
+    printf("%s: overwrite after lseek is wrong\n", s);
+    exit(1);
+  }
+
+  // out of range offsets and bad whence fail, and leave the offset alone
+  if(lseek(fd, 3, SEEK_SET) != 3){
+    printf("%s: lseek failed\n", s);
+    exit(1);
+  }
+  if(lseek(fd, -1, SEEK_SET) != -1 || lseek(fd, 1, SEEK_END) != -1
+     || lseek(fd, -4, SEEK_CUR) != -1 || lseek(fd, 0, 3) != -1){
+    printf("%s: lseek out of range succeeded\n", s);
+    exit(1);
+  }
+  if(lseek(fd, 0, SEEK_CUR) != 3){
+    printf("%s: failed lseek moved the offset\n", s);
+    exit(1);
+  }
+  close(fd);
+  remove("lseekfile");
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(lseek(fds[0], 0, SEEK_SET) != -1){
+    printf("%s: lseek on a pipe succeeded\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// statfs() reports the volume, and its free count follows the
+// clusters files take and give back.
+void
+statfstest(char *s)
+{
+  enum { NCLUS = 4 };
+  struct statfs st0, st1, st2;
+  int fd, n, m;
+
+  if(statfs("/", &st0) < 0){
+    printf("%s: statfs / failed\n", s);
+    exit(1);
+  }
+  if(st0.f_type != MSDOS_SUPER_MAGIC || st0.f_bsize == 0 || st0.f_blocks == 0
+     || st0.f_bfree > st0.f_blocks || st0.f_bavail > st0.f_bfree){
+    printf("%s: statfs / returned nonsense\n", s);
+    exit(1);
+  }
+  if(statfs("statfs.nonexistent", &st1) != -1){
+    printf("%s: statfs of a missing path succeeded\n", s);
+    exit(1);
+  }
+  if(st0.f_bfree < NCLUS + 1){
+    printf("%s: volume too full to test\n", s);
+    exit(0);
+  }
+
+  remove("statfsfile");
+  fd = open("statfsfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create statfsfile failed\n", s);
+    exit(1);
+  }
+  memset(buf, 's', sizeof(buf));
+  for(n = 0; n < NCLUS * st0.f_bsize; n += m){
+    m = NCLUS * st0.f_bsize - n;
+    if(m > sizeof(buf))
+      m = sizeof(buf);
+    if(write(fd, buf, m) != m){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  if(statfs("statfsfile", &st1) < 0 || st1.f_bfree + NCLUS > st0.f_bfree){
+    printf("%s: free count didn't drop by %d clusters\n", s, NCLUS);
+    exit(1);
+  }
+
+  remove("statfsfile");
+  if(statfs("/", &st2) < 0 || st2.f_bfree < st1.f_bfree + NCLUS){
+    printf("%s: free count didn't come back after remove\n", s);
+    exit(1);
+  }
+}
+
+// getdents64() returns each entry of a directory once, packed
+// in records, over as many calls as the buffer needs.
+void
+getdentstest(char *s)
+{
+  char *names[] = { "a", "bb", "sub" };
+  int types[] = { DT_REG, DT_REG, DT_DIR };
+  int seen[3] = { 0 };
+  char dbuf[64], path[16];
+  struct linux_dirent64 *d;
+  int fd, n, i, k;
+
+  if(mkdir("gdir") < 0 || mkdir("gdir/sub") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  for(k = 0; k < 2; k++){
+    strcpy(path, "gdir/");
+    strcpy(path + 5, names[k]);
+    if((fd = open(path, O_CREATE|O_RDWR)) < 0){
+      printf("%s: create %s failed\n", s, path);
+      exit(1);
+    }
+    close(fd);
+  }
+
+  if((fd = open("gdir", O_RDONLY)) < 0){
+    printf("%s: open gdir failed\n", s);
+    exit(1);
+  }
+  // too small for any record
+  if(getdents64(fd, dbuf, 8) != -1){
+    printf("%s: getdents64 into 8 bytes succeeded\n", s);
+    exit(1);
+  }
+  // a small buffer takes several calls
+  while((n = getdents64(fd, dbuf, sizeof(dbuf))) > 0){
+    for(i = 0; i < n; i += d->d_reclen){
+      d = (struct linux_dirent64 *)(dbuf + i);
+      if(d->d_reclen % 8 != 0 || d->d_reclen < DIRENT64_RECLEN(strlen(d->d_name))
+         || i + d->d_reclen > n){
+        printf("%s: bad record length %d\n", s, d->d_reclen);
+        exit(1);
+      }
+      for(k = 0; k < 3; k++){
+        if(strcmp(d->d_name, names[k]) == 0){
+          if(seen[k]++ || d->d_type != types[k]){
+            printf("%s: %s seen twice or with the wrong type\n", s, names[k]);
+            exit(1);
+          }
+        }
+      }
+    }
+  }
+  if(n != 0){
+    printf("%s: getdents64 failed\n", s);
+    exit(1);
+  }
+  for(k = 0; k < 3; k++){
+    if(!seen[k]){
+      printf("%s: %s not returned\n", s, names[k]);
+      exit(1);
+    }
+  }
+  if(getdents64(fd, dbuf, sizeof(dbuf)) != 0){
+    printf("%s: getdents64 past the end returned entries\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if((fd = open("gdir/a", O_RDONLY)) < 0 || getdents64(fd, dbuf, sizeof(dbuf)) != -1){
+    printf("%s: getdents64 of a file succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(remove("gdir/a") < 0 || remove("gdir/bb") < 0 || remove("gdir/sub") < 0
+     || remove("gdir") < 0){
+    printf("%s: remove failed\n", s);
+    exit(1);
+  }
+}
+
+// fallocate() takes clusters for a range up front. Without
+// FALLOC_FL_KEEP_SIZE the size grows over zeroes; with it the
+// size stays and the clusters wait past the end for writes.
+void
+fallocatetest(char *s)
+{
+  enum { N = 3000, KEEP = 8192 };
+  struct stat st;
+  int fd, i;
+
+  remove("fallocfile");
+  fd = open("fallocfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create fallocfile failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "0123456789", 10) != 10){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+
+  if(fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, KEEP) != 0){
+    printf("%s: fallocate keep size failed\n", s);
+    exit(1);
+  }
+  if(fstat(fd, &st) < 0 || st.size != 10){
+    printf("%s: fallocate keep size changed the size\n", s);
+    exit(1);
+  }
+  // writes go on into the clusters kept past the end
+  if(write(fd, "ab", 2) != 2 || fstat(fd, &st) < 0 || st.size != 12){
+    printf("%s: write after fallocate keep size failed\n", s);
+    exit(1);
+  }
+
+  if(fallocate(fd, 0, 0, N) != 0){
+    printf("%s: fallocate failed\n", s);
+    exit(1);
+  }
+  if(fstat(fd, &st) < 0 || st.size != N){
+    printf("%s: fallocate didn't grow the size\n", s);
+    exit(1);
+  }
+  // a range inside the file changes nothing
+  if(fallocate(fd, 0, 0, 5) != 0 || fstat(fd, &st) < 0 || st.size != N){
+    printf("%s: fallocate inside the file changed the size\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("fallocfile", O_RDONLY);
+  memset(buf, 'x', N);
+  if(fd < 0 || read(fd, buf, N) != N){
+    printf("%s: read back failed\n", s);
+    exit(1);
+  }
+  if(memcmp(buf, "0123456789ab", 12) != 0){
+    printf("%s: fallocate changed the data\n", s);
+    exit(1);
+  }
+  for(i = 12; i < N; i++){
+    if(buf[i] != 0){
+      printf("%s: byte %d past the old size is not zero\n", s, i);
+      exit(1);
+    }
+  }
+  // bad arguments, and a file not open for writing
+  if(fallocate(fd, 0, 0, 100) != -1){
+    printf("%s: fallocate of a read-only fd succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("fallocfile", O_RDWR);
+  if(fd < 0 || fallocate(fd, 0, 0, 0) != -1 || fallocate(fd, 0, -1, 10) != -1
+     || fallocate(fd, 0x80, 0, 10) != -1){
+    printf("%s: fallocate with bad arguments succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+  remove("fallocfile");
+}
+
 //
 // use sbrk() to count how many free physical memory pages there are.
 // touches the pages to force allocation.
@@ -2702,6 +3368,14 @@ main(int argc, char *argv[])
     {dirfile, "dirfile"},
     {iref, "iref"},
     {forktest, "forktest"},
+    {cowfork, "cowfork"},
+    {cowcopyout, "cowcopyout"},
+    {cowfree, "cowfree"},
+    {fsynctest, "fsync"},
+    {lseektest, "lseek"},
+    {statfstest, "statfs"},
+    {getdentstest, "getdents64"},
+    {fallocatetest, "fallocate"},
               // {bigdir, "bigdir"}, // slow
     { 0, 0},
   };
@@ -41,3 +41,12 @@ entry("remove");
 entry("trace");
 entry("sysinfo");
 entry("rename");
+entry("iostat");
+entry("sync");
+entry("fsync");
+entry("lseek");
+entry("statfs");
+entry("getdents64");
+entry("fallocate");
+entry("prof");
+entry("ktrace");